@@ -0,0 +1,202 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "capture_rules.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace google { namespace dlp_filter {
+
+namespace {
+static constexpr std::string_view Methods[] = {
+    "GET", "HEAD", "POST", "PUT", "DELETE", "CONNECT", "OPTIONS", "TRACE", "PATCH",
+};
+
+// Bit of a known method, 0 for any other
+uint16_t methodBit(std::string_view method) {
+  for (size_t i = 0; i < std::size(Methods); i++) {
+    if (method == Methods[i]) {
+      return static_cast<uint16_t>(1 << i);
+    }
+  }
+  return 0;
+}
+
+std::string toLower(std::string_view value) {
+  std::string lower(value);
+  std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) {
+    return static_cast<char>(std::tolower(c));
+  });
+  return lower;
+}
+
+// Whether value starts with the lower case prefix, ignoring case
+bool startsWithIgnoreCase(std::string_view value, std::string_view lower_prefix) {
+  if (value.size() < lower_prefix.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < lower_prefix.size(); i++) {
+    if (std::tolower(static_cast<unsigned char>(value[i])) != lower_prefix[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool equalsIgnoreCase(std::string_view value, std::string_view lower) {
+  return value.size() == lower.size() && startsWithIgnoreCase(value, lower);
+}
+
+// Host without its port, if any
+std::string_view stripPort(std::string_view host) {
+  const size_t colon = host.rfind(':');
+  if (colon == std::string_view::npos || host.find(']', colon) != std::string_view::npos) {
+    return host;
+  }
+  return host.substr(0, colon);
+}
+
+bool matchesHost(std::string_view host, const std::vector<std::string>& hosts) {
+  host = stripPort(host);
+  for (const std::string& expected : hosts) {
+    if (expected[0] == '.') {
+      if (host.size() > expected.size()
+          && equalsIgnoreCase(host.substr(host.size() - expected.size()), expected)) {
+        return true;
+      }
+    } else if (equalsIgnoreCase(host, expected)) {
+      return true;
+    }
+  }
+  return false;
+}
+}
+
+bool globMatch(std::string_view pattern, std::string_view text) {
+  size_t p = 0;
+  size_t t = 0;
+  // Position after the last '*' seen and the text position it was tried at
+  size_t star = std::string_view::npos;
+  size_t star_text = 0;
+  while (t < text.size()) {
+    if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t])) {
+      p++;
+      t++;
+    } else if (p < pattern.size() && pattern[p] == '*') {
+      star = ++p;
+      star_text = t;
+    } else if (star != std::string_view::npos) {
+      // Let the last '*' take one more character.
+      p = star;
+      t = ++star_text;
+    } else {
+      return false;
+    }
+  }
+  while (p < pattern.size() && pattern[p] == '*') {
+    p++;
+  }
+  return p == pattern.size();
+}
+
+bool CaptureRules::add(const Rule& rule, std::string* error) {
+  CompiledRule compiled{
+      rule.action == Action::Capture,
+      rule.directions,
+      0,
+      rule.path_prefixes,
+      rule.path_patterns,
+      {},
+      {},
+      rule.min_status,
+      rule.max_status,
+      rule.min_body_bytes,
+      rule.max_body_bytes,
+  };
+  for (const std::string& method : rule.methods) {
+    const uint16_t bit = methodBit(method);
+    if (bit == 0) {
+      *error = "Unknown method: " + method;
+      return false;
+    }
+    compiled.methods |= bit;
+  }
+  for (const std::string& host : rule.hosts) {
+    if (host.empty()) {
+      *error = "Empty host";
+      return false;
+    }
+    compiled.hosts.push_back(toLower(host.rfind("*.", 0) == 0 ? host.substr(1) : host));
+  }
+  for (const std::string& content_type : rule.content_types) {
+    compiled.content_types.push_back(toLower(content_type));
+  }
+  rules_.push_back(std::move(compiled));
+  return true;
+}
+
+CaptureRules::Match CaptureRules::match(const MessageProperties& message) const {
+  const uint8_t direction = message.response ? Response : Request;
+  const uint16_t method = methodBit(message.method);
+  for (size_t i = 0; i < rules_.size(); i++) {
+    const CompiledRule& rule = rules_[i];
+    if ((rule.directions & direction) == 0
+        || (rule.methods != 0 && (rule.methods & method) == 0)) {
+      continue;
+    }
+    if (!rule.path_prefixes.empty()
+        && std::none_of(rule.path_prefixes.begin(), rule.path_prefixes.end(),
+                        [&](const std::string& prefix) {
+                          return message.path.substr(0, prefix.size()) == prefix;
+                        })) {
+      continue;
+    }
+    if (!rule.path_patterns.empty()
+        && std::none_of(rule.path_patterns.begin(), rule.path_patterns.end(),
+                        [&](const std::string& pattern) {
+                          return globMatch(pattern, message.path);
+                        })) {
+      continue;
+    }
+    if (!rule.hosts.empty() && !matchesHost(message.host, rule.hosts)) {
+      continue;
+    }
+    if (!rule.content_types.empty()
+        && std::none_of(rule.content_types.begin(), rule.content_types.end(),
+                        [&](const std::string& content_type) {
+                          return startsWithIgnoreCase(message.content_type, content_type);
+                        })) {
+      continue;
+    }
+    if (rule.min_status != 0 || rule.max_status != 0) {
+      if (!message.response || message.status < rule.min_status
+          || (rule.max_status != 0 && message.status > rule.max_status)) {
+        continue;
+      }
+    }
+    if (rule.min_body_bytes != 0 || rule.max_body_bytes != 0) {
+      if (message.body_size == MessageProperties::UnknownSize) {
+        return {i, true, true};
+      } else if (message.body_size < rule.min_body_bytes
+          || (rule.max_body_bytes != 0 && message.body_size > rule.max_body_bytes)) {
+        continue;
+      }
+    }
+    return {i, rule.capture, false};
+  }
+  return {NoRule, true, false};
+}
+
+}}
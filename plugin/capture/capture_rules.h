@@ -0,0 +1,129 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace google { namespace dlp_filter {
+
+// Properties of a request or response known from its headers. Request
+// properties are also set for the response of the same stream.
+struct MessageProperties {
+  static constexpr uint64_t UnknownSize = UINT64_MAX;
+
+  bool response;
+  std::string_view method;
+  // Path without the query string
+  std::string_view path;
+  std::string_view host;
+  std::string_view content_type;
+  // Response status, 0 for requests
+  uint32_t status;
+  // Body size from content-length, UnknownSize without it
+  uint64_t body_size;
+};
+
+// Ordered rules deciding which messages are captured for inspection.
+//
+// The first rule matching a message decides whether it is captured; messages
+// matching no rule are captured. Within a rule, every condition that is set
+// has to hold, and a condition with several values holds if any value does.
+// Values are normalized when a rule is added, so matching only compares.
+class CaptureRules {
+ public:
+  enum class Action {
+    Capture,
+    Skip,
+  };
+
+  // Directions a rule applies to, as a bit mask
+  static constexpr uint8_t Request = 1;
+  static constexpr uint8_t Response = 2;
+
+  struct Rule {
+    Action action = Action::Capture;
+    uint8_t directions = Request | Response;
+    // HTTP methods, e.g. "GET"
+    std::vector<std::string> methods;
+    std::vector<std::string> path_prefixes;
+    // Globs the whole path has to match: '*' matches any characters, '?'
+    // any one character
+    std::vector<std::string> path_patterns;
+    // Hosts without port, case-insensitive. "*.example.com" matches any
+    // subdomain of example.com.
+    std::vector<std::string> hosts;
+    // Prefixes of the content type, case-insensitive, e.g. "image/"
+    std::vector<std::string> content_types;
+    // Inclusive response status range, unbounded if 0. Requests never match
+    // a rule with a status range.
+    uint32_t min_status = 0;
+    uint32_t max_status = 0;
+    // Inclusive body size range, unbounded if 0
+    uint64_t min_body_bytes = 0;
+    uint64_t max_body_bytes = 0;
+  };
+
+  static constexpr size_t NoRule = SIZE_MAX;
+
+  struct Match {
+    // Index of the deciding rule, NoRule if none matched
+    size_t rule;
+    bool capture;
+    // Whether the deciding rule depends on the body size, which is not known
+    // yet. The message has to be captured and matched again once its size is
+    // known.
+    bool needs_body_size;
+  };
+
+  // Compiles and appends a rule. Fails on unknown methods.
+  bool add(const Rule& rule, std::string* error);
+
+  Match match(const MessageProperties& message) const;
+
+  bool empty() const {
+    return rules_.empty();
+  }
+
+  size_t size() const {
+    return rules_.size();
+  }
+
+ private:
+  struct CompiledRule {
+    bool capture;
+    uint8_t directions;
+    // Bit per known method, 0 for any method
+    uint16_t methods;
+    std::vector<std::string> path_prefixes;
+    std::vector<std::string> path_patterns;
+    // Lower case; wildcard hosts are kept as their ".example.com" suffix
+    std::vector<std::string> hosts;
+    std::vector<std::string> content_types;
+    uint32_t min_status;
+    uint32_t max_status;
+    uint64_t min_body_bytes;
+    uint64_t max_body_bytes;
+  };
+
+  std::vector<CompiledRule> rules_;
+};
+
+// Whether text matches a glob where '*' matches any characters and '?' any
+// one character.
+bool globMatch(std::string_view pattern, std::string_view text);
+
+}}
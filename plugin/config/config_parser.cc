@@ -0,0 +1,812 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "config_parser.h"
+
+#include <cctype>
+
+#include "json.h"
+
+namespace google { namespace dlp_filter {
+
+namespace {
+
+// Smallest max_run_bytes: shorter prefixes cut most API keys and access
+// tokens
+constexpr uint32_t MinMaxRunBytes = 64;
+
+// Whether key names the field, either as the proto field name or as its
+// lowerCamelCase JSON name.
+bool isField(const std::string& key, std::string_view proto_name) {
+  if (key == proto_name) {
+    return true;
+  }
+  size_t k = 0;
+  for (size_t i = 0; i < proto_name.size(); i++, k++) {
+    char expected = proto_name[i];
+    if (expected == '_' && i + 1 < proto_name.size()) {
+      expected = static_cast<char>(std::toupper(proto_name[++i]));
+    }
+    if (k >= key.size() || key[k] != expected) {
+      return false;
+    }
+  }
+  return k == key.size();
+}
+
+bool fail(std::string* error, const std::string& message) {
+  *error = message;
+  return false;
+}
+
+bool unknownField(std::string* error, const char* message, const std::string& key) {
+  return fail(error, std::string("Unknown field '") + key + "' in " + message);
+}
+
+bool expectObject(const JsonValue& value, const char* message, std::string* error) {
+  if (value.type() != JsonValue::Object) {
+    return fail(error, std::string("Expected an object for ") + message);
+  }
+  return true;
+}
+
+bool readString(const JsonValue& value, const std::string& key, std::string* out,
+                std::string* error) {
+  if (value.type() != JsonValue::String) {
+    return fail(error, std::string("Expected a string for '") + key + "'");
+  }
+  *out = value.stringValue();
+  return true;
+}
+
+bool readBool(const JsonValue& value, const std::string& key, bool* out, std::string* error) {
+  if (value.type() != JsonValue::Bool) {
+    return fail(error, std::string("Expected a boolean for '") + key + "'");
+  }
+  *out = value.boolValue();
+  return true;
+}
+
+bool readUint64(const JsonValue& value, const std::string& key, uint64_t* out,
+                std::string* error) {
+  if (!jsonToUint64(value, out)) {
+    return fail(error, std::string("Expected an unsigned integer for '") + key + "'");
+  }
+  return true;
+}
+
+bool readUint32(const JsonValue& value, const std::string& key, uint32_t* out,
+                std::string* error) {
+  uint64_t wide;
+  if (!readUint64(value, key, &wide, error)) {
+    return false;
+  } else if (wide > UINT32_MAX) {
+    return fail(error, std::string("Value out of range for '") + key + "'");
+  }
+  *out = static_cast<uint32_t>(wide);
+  return true;
+}
+
+// Enums are accepted both by name and by number, as in the proto3 JSON mapping.
+bool readDenominator(const JsonValue& value, const std::string& key,
+                     ::dlp::FractionalPercent_DenominatorType* out, std::string* error) {
+  if (value.type() == JsonValue::Number) {
+    uint32_t number;
+    if (!readUint32(value, key, &number, error)) {
+      return false;
+    } else if (!::dlp::FractionalPercent_DenominatorType_IsValid(static_cast<int>(number))) {
+      return fail(error, "Unknown denominator: " + value.stringValue());
+    }
+    *out = static_cast<::dlp::FractionalPercent_DenominatorType>(number);
+  } else if (value.stringValue() == "HUNDRED") {
+    *out = ::dlp::FractionalPercent_DenominatorType_HUNDRED;
+  } else if (value.stringValue() == "TEN_THOUSAND") {
+    *out = ::dlp::FractionalPercent_DenominatorType_TEN_THOUSAND;
+  } else if (value.stringValue() == "MILLION") {
+    *out = ::dlp::FractionalPercent_DenominatorType_MILLION;
+  } else {
+    return fail(error, "Unknown denominator: " + value.stringValue());
+  }
+  return true;
+}
+
+bool parseFractionalPercent(const JsonValue& value, ::dlp::FractionalPercent* percent,
+                            std::string* error) {
+  if (!expectObject(value, "FractionalPercent", error)) {
+    return false;
+  }
+  for (const auto& [key, field] : value.objectValue()) {
+    if (field.type() == JsonValue::Null) {
+      continue;
+    } else if (isField(key, "numerator")) {
+      uint32_t numerator;
+      if (!readUint32(field, key, &numerator, error)) {
+        return false;
+      }
+      percent->set_numerator(numerator);
+    } else if (isField(key, "denominator")) {
+      ::dlp::FractionalPercent_DenominatorType denominator;
+      if (!readDenominator(field, key, &denominator, error)) {
+        return false;
+      }
+      percent->set_denominator(denominator);
+    } else {
+      return unknownField(error, "FractionalPercent", key);
+    }
+  }
+  return true;
+}
+
+bool parseSamplingConfig(const JsonValue& value, ::dlp::SamplingConfig* sampling,
+                         std::string* error) {
+  if (!expectObject(value, "SamplingConfig", error)) {
+    return false;
+  }
+  for (const auto& [key, field] : value.objectValue()) {
+    if (field.type() == JsonValue::Null) {
+      continue;
+    } else if (isField(key, "probability")) {
+      if (!parseFractionalPercent(field, sampling->mutable_probability(), error)) {
+        return false;
+      }
+    } else {
+      return unknownField(error, "SamplingConfig", key);
+    }
+  }
+  return true;
+}
+
+bool parseStoreFindingsLocally(const JsonValue& value, ::dlp::StoreFindingsLocally* store_local,
+                               std::string* error) {
+  if (!expectObject(value, "StoreFindingsLocally", error)) {
+    return false;
+  }
+  for (const auto& [key, field] : value.objectValue()) {
+    if (field.type() == JsonValue::Null) {
+      continue;
+    } else if (isField(key, "project_id")) {
+      if (!readString(field, key, store_local->mutable_project_id(), error)) {
+        return false;
+      }
+    } else if (isField(key, "location_id")) {
+      if (!readString(field, key, store_local->mutable_location_id(), error)) {
+        return false;
+      }
+    } else if (isField(key, "inspect_template_name")) {
+      if (!readString(field, key, store_local->mutable_inspect_template_name(), error)) {
+        return false;
+      }
+    } else {
+      return unknownField(error, "StoreFindingsLocally", key);
+    }
+  }
+  return true;
+}
+
+bool parseHybridInspect(const JsonValue& value, ::dlp::HybridInspect* hybrid_inspect,
+                        std::string* error) {
+  if (!expectObject(value, "HybridInspect", error)) {
+    return false;
+  }
+  for (const auto& [key, field] : value.objectValue()) {
+    if (field.type() == JsonValue::Null) {
+      continue;
+    } else if (isField(key, "job_trigger_name")) {
+      if (!readString(field, key, hybrid_inspect->mutable_job_trigger_name(), error)) {
+        return false;
+      }
+    } else if (isField(key, "max_batch_size")) {
+      uint32_t max_batch_size;
+      if (!readUint32(field, key, &max_batch_size, error)) {
+        return false;
+      }
+      hybrid_inspect->set_max_batch_size(max_batch_size);
+    } else if (isField(key, "max_batch_delay_ms")) {
+      uint32_t max_batch_delay_ms;
+      if (!readUint32(field, key, &max_batch_delay_ms, error)) {
+        return false;
+      }
+      hybrid_inspect->set_max_batch_delay_ms(max_batch_delay_ms);
+    } else {
+      return unknownField(error, "HybridInspect", key);
+    }
+  }
+  return true;
+}
+
+bool parseDestinationOperation(const JsonValue& value, ::dlp::DestinationOperation* operation,
+                               std::string* error) {
+  if (!expectObject(value, "DestinationOperation", error)) {
+    return false;
+  }
+  for (const auto& [key, field] : value.objectValue()) {
+    if (field.type() == JsonValue::Null) {
+      continue;
+    } else if (isField(key, "store_local")) {
+      if (!parseStoreFindingsLocally(field, operation->mutable_store_local(), error)) {
+        return false;
+      }
+    } else if (isField(key, "hybrid_inspect")) {
+      if (!parseHybridInspect(field, operation->mutable_hybrid_inspect(), error)) {
+        return false;
+      }
+    } else {
+      return unknownField(error, "DestinationOperation", key);
+    }
+  }
+  return true;
+}
+
+bool parseChannelCredentials(const JsonValue& value,
+                             GrpcService_GoogleGrpc_ChannelCredentials* credentials,
+                             std::string* error) {
+  if (!expectObject(value, "ChannelCredentials", error)) {
+    return false;
+  }
+  for (const auto& [key, field] : value.objectValue()) {
+    if (field.type() == JsonValue::Null) {
+      continue;
+    } else if (isField(key, "google_default")) {
+      if (!expectObject(field, "google_default", error)) {
+        return false;
+      }
+      credentials->mutable_google_default();
+    } else {
+      return unknownField(error, "ChannelCredentials", key);
+    }
+  }
+  return true;
+}
+
+bool parseGoogleGrpc(const JsonValue& value, GrpcService_GoogleGrpc* google_grpc,
+                     std::string* error) {
+  if (!expectObject(value, "GoogleGrpc", error)) {
+    return false;
+  }
+  for (const auto& [key, field] : value.objectValue()) {
+    if (field.type() == JsonValue::Null) {
+      continue;
+    } else if (isField(key, "target_uri")) {
+      if (!readString(field, key, google_grpc->mutable_target_uri(), error)) {
+        return false;
+      }
+    } else if (isField(key, "stat_prefix")) {
+      if (!readString(field, key, google_grpc->mutable_stat_prefix(), error)) {
+        return false;
+      }
+    } else if (isField(key, "channel_credentials")) {
+      if (!parseChannelCredentials(field, google_grpc->mutable_channel_credentials(), error)) {
+        return false;
+      }
+    } else {
+      return unknownField(error, "GoogleGrpc", key);
+    }
+  }
+  return true;
+}
+
+bool parseEndpoint(const JsonValue& value, ::dlp::Endpoint* endpoint, std::string* error) {
+  if (!expectObject(value, "Endpoint", error)) {
+    return false;
+  }
+  for (const auto& [key, field] : value.objectValue()) {
+    if (field.type() == JsonValue::Null) {
+      continue;
+    } else if (isField(key, "grpc_config")) {
+      if (!parseGoogleGrpc(field, endpoint->mutable_grpc_config(), error)) {
+        return false;
+      }
+    } else if (isField(key, "location_id")) {
+      if (!readString(field, key, endpoint->mutable_location_id(), error)) {
+        return false;
+      }
+    } else if (isField(key, "weight")) {
+      uint32_t weight;
+      if (!readUint32(field, key, &weight, error)) {
+        return false;
+      }
+      endpoint->set_weight(weight);
+    } else {
+      return unknownField(error, "Endpoint", key);
+    }
+  }
+  return true;
+}
+
+bool parseDestination(const JsonValue& value, ::dlp::Destination* destination,
+                      std::string* error) {
+  if (!expectObject(value, "Destination", error)) {
+    return false;
+  }
+  for (const auto& [key, field] : value.objectValue()) {
+    if (field.type() == JsonValue::Null) {
+      continue;
+    } else if (isField(key, "grpc_config")) {
+      if (!parseGoogleGrpc(field, destination->mutable_grpc_config(), error)) {
+        return false;
+      }
+    } else if (isField(key, "operation")) {
+      if (!parseDestinationOperation(field, destination->mutable_operation(), error)) {
+        return false;
+      }
+    } else if (isField(key, "endpoints")) {
+      if (field.type() != JsonValue::Array) {
+        return fail(error, "Expected an array for '" + key + "'");
+      }
+      for (const JsonValue& endpoint : field.arrayValue()) {
+        if (!parseEndpoint(endpoint, destination->add_endpoints(), error)) {
+          return false;
+        }
+      }
+    } else if (isField(key, "max_consecutive_failures")) {
+      uint32_t max_consecutive_failures;
+      if (!readUint32(field, key, &max_consecutive_failures, error)) {
+        return false;
+      }
+      destination->set_max_consecutive_failures(max_consecutive_failures);
+    } else if (isField(key, "ejection_time_ms")) {
+      uint32_t ejection_time_ms;
+      if (!readUint32(field, key, &ejection_time_ms, error)) {
+        return false;
+      }
+      destination->set_ejection_time_ms(ejection_time_ms);
+    } else {
+      return unknownField(error, "Destination", key);
+    }
+  }
+  return true;
+}
+
+bool parseStatsConfig(const JsonValue& value, ::dlp::StatsConfig* stats, std::string* error) {
+  if (!expectObject(value, "StatsConfig", error)) {
+    return false;
+  }
+  for (const auto& [key, field] : value.objectValue()) {
+    if (field.type() == JsonValue::Null) {
+      continue;
+    } else if (isField(key, "max_tag_values")) {
+      uint32_t max_tag_values;
+      if (!readUint32(field, key, &max_tag_values, error)) {
+        return false;
+      }
+      stats->set_max_tag_values(max_tag_values);
+    } else if (isField(key, "flush_interval_ms")) {
+      uint32_t flush_interval_ms;
+      if (!readUint32(field, key, &flush_interval_ms, error)) {
+        return false;
+      }
+      stats->set_flush_interval_ms(flush_interval_ms);
+    } else if (isField(key, "record_immediately")) {
+      bool record_immediately;
+      if (!readBool(field, key, &record_immediately, error)) {
+        return false;
+      }
+      stats->set_record_immediately(record_immediately);
+    } else {
+      return unknownField(error, "StatsConfig", key);
+    }
+  }
+  return true;
+}
+
+bool parseRateLimit(const JsonValue& value, ::dlp::RateLimit* rate_limit, std::string* error) {
+  if (!expectObject(value, "RateLimit", error)) {
+    return false;
+  }
+  for (const auto& [key, field] : value.objectValue()) {
+    if (field.type() == JsonValue::Null) {
+      continue;
+    } else if (isField(key, "calls_per_second")) {
+      uint32_t calls_per_second;
+      if (!readUint32(field, key, &calls_per_second, error)) {
+        return false;
+      }
+      rate_limit->set_calls_per_second(calls_per_second);
+    } else if (isField(key, "burst")) {
+      uint32_t burst;
+      if (!readUint32(field, key, &burst, error)) {
+        return false;
+      }
+      rate_limit->set_burst(burst);
+    } else {
+      return unknownField(error, "RateLimit", key);
+    }
+  }
+  return true;
+}
+
+bool readStrings(const JsonValue& value, const std::string& key,
+                 google::protobuf::RepeatedPtrField<std::string>* out, std::string* error) {
+  if (value.type() != JsonValue::Array) {
+    return fail(error, "Expected an array for '" + key + "'");
+  }
+  for (const JsonValue& item : value.arrayValue()) {
+    if (!readString(item, key, out->Add(), error)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool readCaptureAction(const JsonValue& value, const std::string& key,
+                       ::dlp::CaptureRule_Action* out, std::string* error) {
+  if (value.type() == JsonValue::Number) {
+    uint32_t number;
+    if (!readUint32(value, key, &number, error)) {
+      return false;
+    } else if (!::dlp::CaptureRule_Action_IsValid(static_cast<int>(number))) {
+      return fail(error, "Unknown action: " + value.stringValue());
+    }
+    *out = static_cast<::dlp::CaptureRule_Action>(number);
+  } else if (value.stringValue() == "CAPTURE") {
+    *out = ::dlp::CaptureRule_Action_CAPTURE;
+  } else if (value.stringValue() == "SKIP") {
+    *out = ::dlp::CaptureRule_Action_SKIP;
+  } else {
+    return fail(error, "Unknown action: " + value.stringValue());
+  }
+  return true;
+}
+
+bool readCaptureDirection(const JsonValue& value, const std::string& key,
+                          ::dlp::CaptureRule_Direction* out, std::string* error) {
+  if (value.type() == JsonValue::Number) {
+    uint32_t number;
+    if (!readUint32(value, key, &number, error)) {
+      return false;
+    } else if (!::dlp::CaptureRule_Direction_IsValid(static_cast<int>(number))) {
+      return fail(error, "Unknown direction: " + value.stringValue());
+    }
+    *out = static_cast<::dlp::CaptureRule_Direction>(number);
+  } else if (value.stringValue() == "BOTH") {
+    *out = ::dlp::CaptureRule_Direction_BOTH;
+  } else if (value.stringValue() == "REQUEST") {
+    *out = ::dlp::CaptureRule_Direction_REQUEST;
+  } else if (value.stringValue() == "RESPONSE") {
+    *out = ::dlp::CaptureRule_Direction_RESPONSE;
+  } else {
+    return fail(error, "Unknown direction: " + value.stringValue());
+  }
+  return true;
+}
+
+bool parseCaptureRule(const JsonValue& value, ::dlp::CaptureRule* rule, std::string* error) {
+  if (!expectObject(value, "CaptureRule", error)) {
+    return false;
+  }
+  for (const auto& [key, field] : value.objectValue()) {
+    if (field.type() == JsonValue::Null) {
+      continue;
+    } else if (isField(key, "name")) {
+      if (!readString(field, key, rule->mutable_name(), error)) {
+        return false;
+      }
+    } else if (isField(key, "action")) {
+      ::dlp::CaptureRule_Action action;
+      if (!readCaptureAction(field, key, &action, error)) {
+        return false;
+      }
+      rule->set_action(action);
+    } else if (isField(key, "direction")) {
+      ::dlp::CaptureRule_Direction direction;
+      if (!readCaptureDirection(field, key, &direction, error)) {
+        return false;
+      }
+      rule->set_direction(direction);
+    } else if (isField(key, "methods")) {
+      if (!readStrings(field, key, rule->mutable_methods(), error)) {
+        return false;
+      }
+    } else if (isField(key, "path_prefixes")) {
+      if (!readStrings(field, key, rule->mutable_path_prefixes(), error)) {
+        return false;
+      }
+    } else if (isField(key, "path_patterns")) {
+      if (!readStrings(field, key, rule->mutable_path_patterns(), error)) {
+        return false;
+      }
+    } else if (isField(key, "hosts")) {
+      if (!readStrings(field, key, rule->mutable_hosts(), error)) {
+        return false;
+      }
+    } else if (isField(key, "content_types")) {
+      if (!readStrings(field, key, rule->mutable_content_types(), error)) {
+        return false;
+      }
+    } else if (isField(key, "min_status")) {
+      uint32_t min_status;
+      if (!readUint32(field, key, &min_status, error)) {
+        return false;
+      }
+      rule->set_min_status(min_status);
+    } else if (isField(key, "max_status")) {
+      uint32_t max_status;
+      if (!readUint32(field, key, &max_status, error)) {
+        return false;
+      }
+      rule->set_max_status(max_status);
+    } else if (isField(key, "min_body_bytes")) {
+      uint64_t min_body_bytes;
+      if (!readUint64(field, key, &min_body_bytes, error)) {
+        return false;
+      }
+      rule->set_min_body_bytes(min_body_bytes);
+    } else if (isField(key, "max_body_bytes")) {
+      uint64_t max_body_bytes;
+      if (!readUint64(field, key, &max_body_bytes, error)) {
+        return false;
+      }
+      rule->set_max_body_bytes(max_body_bytes);
+    } else {
+      return unknownField(error, "CaptureRule", key);
+    }
+  }
+  return true;
+}
+
+bool parseSpoolConfig(const JsonValue& value, ::dlp::SpoolConfig* spool, std::string* error) {
+  if (!expectObject(value, "SpoolConfig", error)) {
+    return false;
+  }
+  for (const auto& [key, field] : value.objectValue()) {
+    if (field.type() == JsonValue::Null) {
+      continue;
+    } else if (isField(key, "max_bytes")) {
+      uint64_t max_bytes;
+      if (!readUint64(field, key, &max_bytes, error)) {
+        return false;
+      }
+      spool->set_max_bytes(max_bytes);
+    } else if (isField(key, "max_entries")) {
+      uint32_t max_entries;
+      if (!readUint32(field, key, &max_entries, error)) {
+        return false;
+      }
+      spool->set_max_entries(max_entries);
+    } else if (isField(key, "max_age_ms")) {
+      uint32_t max_age_ms;
+      if (!readUint32(field, key, &max_age_ms, error)) {
+        return false;
+      }
+      spool->set_max_age_ms(max_age_ms);
+    } else if (isField(key, "drain_per_second")) {
+      uint32_t drain_per_second;
+      if (!readUint32(field, key, &drain_per_second, error)) {
+        return false;
+      }
+      spool->set_drain_per_second(drain_per_second);
+    } else {
+      return unknownField(error, "SpoolConfig", key);
+    }
+  }
+  return true;
+}
+
+bool parseMinimizeConfig(const JsonValue& value, ::dlp::MinimizeConfig* minimize,
+                         std::string* error) {
+  if (!expectObject(value, "MinimizeConfig", error)) {
+    return false;
+  }
+  for (const auto& [key, field] : value.objectValue()) {
+    if (field.type() == JsonValue::Null) {
+      continue;
+    } else if (isField(key, "collapse_whitespace")) {
+      bool collapse_whitespace;
+      if (!readBool(field, key, &collapse_whitespace, error)) {
+        return false;
+      }
+      minimize->set_collapse_whitespace(collapse_whitespace);
+    } else if (isField(key, "max_run_bytes")) {
+      uint32_t max_run_bytes;
+      if (!readUint32(field, key, &max_run_bytes, error)) {
+        return false;
+      }
+      if (max_run_bytes > 0 && max_run_bytes < MinMaxRunBytes) {
+        return fail(error, "max_run_bytes has to be 0 or at least "
+                               + std::to_string(MinMaxRunBytes));
+      }
+      minimize->set_max_run_bytes(max_run_bytes);
+    } else {
+      return unknownField(error, "MinimizeConfig", key);
+    }
+  }
+  return true;
+}
+
+bool parseLearnedSecretsConfig(const JsonValue& value,
+                               ::dlp::LearnedSecretsConfig* learned_secrets, std::string* error) {
+  if (!expectObject(value, "LearnedSecretsConfig", error)) {
+    return false;
+  }
+  for (const auto& [key, field] : value.objectValue()) {
+    if (field.type() == JsonValue::Null) {
+      continue;
+    } else if (isField(key, "max_entries")) {
+      uint32_t max_entries;
+      if (!readUint32(field, key, &max_entries, error)) {
+        return false;
+      }
+      learned_secrets->set_max_entries(max_entries);
+    } else if (isField(key, "ttl_ms")) {
+      uint32_t ttl_ms;
+      if (!readUint32(field, key, &ttl_ms, error)) {
+        return false;
+      }
+      learned_secrets->set_ttl_ms(ttl_ms);
+    } else {
+      return unknownField(error, "LearnedSecretsConfig", key);
+    }
+  }
+  return true;
+}
+
+bool parseCoalesceConfig(const JsonValue& value, ::dlp::CoalesceConfig* coalesce,
+                         std::string* error) {
+  if (!expectObject(value, "CoalesceConfig", error)) {
+    return false;
+  }
+  for (const auto& [key, field] : value.objectValue()) {
+    if (field.type() == JsonValue::Null) {
+      continue;
+    } else if (isField(key, "max_delay_ms")) {
+      uint32_t max_delay_ms;
+      if (!readUint32(field, key, &max_delay_ms, error)) {
+        return false;
+      }
+      coalesce->set_max_delay_ms(max_delay_ms);
+    } else if (isField(key, "request_headers")) {
+      if (!readStrings(field, key, coalesce->mutable_request_headers(), error)) {
+        return false;
+      }
+    } else {
+      return unknownField(error, "CoalesceConfig", key);
+    }
+  }
+  return true;
+}
+
+bool parseEnforceConfig(const JsonValue& value, ::dlp::EnforceConfig* enforce,
+                        std::string* error) {
+  if (!expectObject(value, "EnforceConfig", error)) {
+    return false;
+  }
+  for (const auto& [key, field] : value.objectValue()) {
+    if (field.type() == JsonValue::Null) {
+      continue;
+    } else if (isField(key, "routes")) {
+      if (!readStrings(field, key, enforce->mutable_routes(), error)) {
+        return false;
+      }
+    } else if (isField(key, "deadline_ms")) {
+      uint32_t deadline_ms;
+      if (!readUint32(field, key, &deadline_ms, error)) {
+        return false;
+      }
+      enforce->set_deadline_ms(deadline_ms);
+    } else if (isField(key, "fail_closed")) {
+      bool fail_closed;
+      if (!readBool(field, key, &fail_closed, error)) {
+        return false;
+      }
+      enforce->set_fail_closed(fail_closed);
+    } else if (isField(key, "status_code")) {
+      uint32_t status_code;
+      if (!readUint32(field, key, &status_code, error)) {
+        return false;
+      }
+      enforce->set_status_code(status_code);
+    } else if (isField(key, "body")) {
+      if (!readString(field, key, enforce->mutable_body(), error)) {
+        return false;
+      }
+    } else {
+      return unknownField(error, "EnforceConfig", key);
+    }
+  }
+  return true;
+}
+
+bool parseTrafficInspectConfig(const JsonValue& value, ::dlp::TrafficInspectConfig* inspect,
+                               std::string* error) {
+  if (!expectObject(value, "TrafficInspectConfig", error)) {
+    return false;
+  }
+  for (const auto& [key, field] : value.objectValue()) {
+    if (field.type() == JsonValue::Null) {
+      continue;
+    } else if (isField(key, "destination")) {
+      if (!parseDestination(field, inspect->mutable_destination(), error)) {
+        return false;
+      }
+    } else if (isField(key, "sampling")) {
+      if (!parseSamplingConfig(field, inspect->mutable_sampling(), error)) {
+        return false;
+      }
+    } else if (isField(key, "max_request_size_bytes")) {
+      uint64_t max_request_size_bytes;
+      if (!readUint64(field, key, &max_request_size_bytes, error)) {
+        return false;
+      }
+      inspect->set_max_request_size_bytes(max_request_size_bytes);
+    } else if (isField(key, "stats")) {
+      if (!parseStatsConfig(field, inspect->mutable_stats(), error)) {
+        return false;
+      }
+    } else if (isField(key, "rate_limit")) {
+      if (!parseRateLimit(field, inspect->mutable_rate_limit(), error)) {
+        return false;
+      }
+    } else if (isField(key, "capture_rules")) {
+      if (field.type() != JsonValue::Array) {
+        return fail(error, "Expected an array for '" + key + "'");
+      }
+      for (const JsonValue& rule : field.arrayValue()) {
+        if (!parseCaptureRule(rule, inspect->add_capture_rules(), error)) {
+          return false;
+        }
+      }
+    } else if (isField(key, "spool")) {
+      if (!parseSpoolConfig(field, inspect->mutable_spool(), error)) {
+        return false;
+      }
+    } else if (isField(key, "minimize")) {
+      if (!parseMinimizeConfig(field, inspect->mutable_minimize(), error)) {
+        return false;
+      }
+    } else if (isField(key, "learned_secrets")) {
+      if (!parseLearnedSecretsConfig(field, inspect->mutable_learned_secrets(), error)) {
+        return false;
+      }
+    } else if (isField(key, "coalesce")) {
+      if (!parseCoalesceConfig(field, inspect->mutable_coalesce(), error)) {
+        return false;
+      }
+    } else if (isField(key, "enforce")) {
+      if (!parseEnforceConfig(field, inspect->mutable_enforce(), error)) {
+        return false;
+      }
+    } else {
+      return unknownField(error, "TrafficInspectConfig", key);
+    }
+  }
+  return true;
+}
+
+}
+
+bool parsePluginConfig(std::string_view json, ::dlp::PluginConfig* config, std::string* error) {
+  JsonValue document;
+  std::string json_error;
+  if (!parseJson(json, &document, &json_error)) {
+    return fail(error, "Malformed JSON: " + json_error);
+  }
+  if (!expectObject(document, "PluginConfig", error)) {
+    return false;
+  }
+  config->Clear();
+  for (const auto& [key, field] : document.objectValue()) {
+    if (field.type() == JsonValue::Null) {
+      continue;
+    } else if (isField(key, "inspect")) {
+      if (!parseTrafficInspectConfig(field, config->mutable_inspect(), error)) {
+        return false;
+      }
+    } else {
+      return unknownField(error, "PluginConfig", key);
+    }
+  }
+  return true;
+}
+
+}}
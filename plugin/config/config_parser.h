@@ -0,0 +1,40 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#ifdef PROXY_WASM_PROTOBUF_LITE
+#include "plugin/config_lite.pb.h"
+#else
+#include "plugin/config.pb.h"
+#endif
+
+namespace google { namespace dlp_filter {
+
+// Fills config from the JSON form of dlp.PluginConfig without protobuf
+// reflection, so it works against protobuf-lite generated classes.
+//
+// Field names are accepted both in their proto (snake_case) and JSON
+// (lowerCamelCase) form and enums both by name and by number. Unknown fields
+// are rejected. Within GrpcService.GoogleGrpc only target_uri, stat_prefix and
+// the google_default channel credentials are supported; other fields fail the
+// parse so a configuration is never silently narrowed.
+//
+// Returns false and describes the problem in error if the document cannot be
+// mapped onto the config.
+bool parsePluginConfig(std::string_view json, ::dlp::PluginConfig* config, std::string* error);
+
+}}
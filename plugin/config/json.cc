@@ -0,0 +1,333 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "json.h"
+
+namespace google { namespace dlp_filter {
+
+namespace {
+// Configuration documents are shallow, this only guards against stack
+// exhaustion on hostile input.
+static const int MaxDepth = 64;
+}
+
+class JsonParser {
+ public:
+  JsonParser(std::string_view text, std::string* error)
+      : text_(text), pos_(0), error_(error) {}
+
+  bool parseDocument(JsonValue* out) {
+    if (!parseValue(out, 0)) {
+      return false;
+    }
+    skipWhitespace();
+    if (pos_ != text_.size()) {
+      return fail("unexpected trailing characters");
+    }
+    return true;
+  }
+
+ private:
+  bool parseValue(JsonValue* out, int depth) {
+    if (depth > MaxDepth) {
+      return fail("document nested too deeply");
+    }
+    skipWhitespace();
+    if (pos_ >= text_.size()) {
+      return fail("unexpected end of input");
+    }
+    switch (text_[pos_]) {
+      case '{':
+        return parseObject(out, depth);
+      case '[':
+        return parseArray(out, depth);
+      case '"':
+        out->type_ = JsonValue::String;
+        return parseString(&out->string_value_);
+      case 't':
+        out->type_ = JsonValue::Bool;
+        out->bool_value_ = true;
+        return consumeLiteral("true");
+      case 'f':
+        out->type_ = JsonValue::Bool;
+        out->bool_value_ = false;
+        return consumeLiteral("false");
+      case 'n':
+        out->type_ = JsonValue::Null;
+        return consumeLiteral("null");
+      default:
+        return parseNumber(out);
+    }
+  }
+
+  bool parseObject(JsonValue* out, int depth) {
+    out->type_ = JsonValue::Object;
+    ++pos_;
+    while (true) {
+      skipWhitespace();
+      if (pos_ < text_.size() && text_[pos_] == '}') {
+        ++pos_;
+        return true;
+      }
+      std::string key;
+      if (pos_ >= text_.size() || text_[pos_] != '"') {
+        return fail("expected object key");
+      }
+      if (!parseString(&key)) {
+        return false;
+      }
+      skipWhitespace();
+      if (pos_ >= text_.size() || text_[pos_] != ':') {
+        return fail("expected ':' after object key");
+      }
+      ++pos_;
+      out->object_value_.emplace_back(std::move(key), JsonValue());
+      if (!parseValue(&out->object_value_.back().second, depth + 1)) {
+        return false;
+      }
+      if (!consumeSeparator('}')) {
+        return false;
+      }
+    }
+  }
+
+  bool parseArray(JsonValue* out, int depth) {
+    out->type_ = JsonValue::Array;
+    ++pos_;
+    while (true) {
+      skipWhitespace();
+      if (pos_ < text_.size() && text_[pos_] == ']') {
+        ++pos_;
+        return true;
+      }
+      out->array_value_.emplace_back();
+      if (!parseValue(&out->array_value_.back(), depth + 1)) {
+        return false;
+      }
+      if (!consumeSeparator(']')) {
+        return false;
+      }
+    }
+  }
+
+  // Consumes the ',' between elements. The closing character is left for the
+  // caller so that a trailing comma is accepted.
+  bool consumeSeparator(char closing) {
+    skipWhitespace();
+    if (pos_ < text_.size() && text_[pos_] == ',') {
+      ++pos_;
+      return true;
+    }
+    if (pos_ < text_.size() && text_[pos_] == closing) {
+      return true;
+    }
+    return fail(std::string("expected ',' or '") + closing + "'");
+  }
+
+  bool parseString(std::string* out) {
+    ++pos_;
+    while (pos_ < text_.size()) {
+      const char c = text_[pos_++];
+      if (c == '"') {
+        return true;
+      } else if (c != '\\') {
+        out->push_back(c);
+        continue;
+      }
+      if (pos_ >= text_.size()) {
+        break;
+      }
+      const char escaped = text_[pos_++];
+      switch (escaped) {
+        case '"':
+        case '\\':
+        case '/':
+          out->push_back(escaped);
+          break;
+        case 'b':
+          out->push_back('\b');
+          break;
+        case 'f':
+          out->push_back('\f');
+          break;
+        case 'n':
+          out->push_back('\n');
+          break;
+        case 'r':
+          out->push_back('\r');
+          break;
+        case 't':
+          out->push_back('\t');
+          break;
+        case 'u':
+          if (!parseUnicodeEscape(out)) {
+            return false;
+          }
+          break;
+        default:
+          return fail("invalid escape sequence");
+      }
+    }
+    return fail("unterminated string");
+  }
+
+  bool parseUnicodeEscape(std::string* out) {
+    uint32_t code_point = 0;
+    if (!readHex4(&code_point)) {
+      return false;
+    }
+    if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+      uint32_t low = 0;
+      if (text_.substr(pos_, 2) != "\\u") {
+        return fail("unpaired surrogate in \\u escape");
+      }
+      pos_ += 2;
+      if (!readHex4(&low) || low < 0xDC00 || low > 0xDFFF) {
+        return fail("invalid surrogate pair in \\u escape");
+      }
+      code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+    }
+    if (code_point < 0x80) {
+      out->push_back(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+      out->push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+      out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+      out->push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+      out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else {
+      out->push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+      out->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+    return true;
+  }
+
+  bool readHex4(uint32_t* out) {
+    if (pos_ + 4 > text_.size()) {
+      return fail("truncated \\u escape");
+    }
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+      const char c = text_[pos_++];
+      value <<= 4;
+      if (c >= '0' && c <= '9') {
+        value |= c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        value |= c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        value |= c - 'A' + 10;
+      } else {
+        return fail("invalid hex digit in \\u escape");
+      }
+    }
+    *out = value;
+    return true;
+  }
+
+  // Validates the number grammar and stores its raw text.
+  bool parseNumber(JsonValue* out) {
+    const size_t start = pos_;
+    if (pos_ < text_.size() && text_[pos_] == '-') {
+      ++pos_;
+    }
+    if (!consumeDigits()) {
+      return fail("invalid value");
+    }
+    if (pos_ < text_.size() && text_[pos_] == '.') {
+      ++pos_;
+      if (!consumeDigits()) {
+        return fail("invalid number");
+      }
+    }
+    if (pos_ < text_.size() && (text_[pos_] == 'e' || text_[pos_] == 'E')) {
+      ++pos_;
+      if (pos_ < text_.size() && (text_[pos_] == '+' || text_[pos_] == '-')) {
+        ++pos_;
+      }
+      if (!consumeDigits()) {
+        return fail("invalid number");
+      }
+    }
+    out->type_ = JsonValue::Number;
+    out->string_value_ = std::string(text_.substr(start, pos_ - start));
+    return true;
+  }
+
+  bool consumeDigits() {
+    const size_t start = pos_;
+    while (pos_ < text_.size() && text_[pos_] >= '0' && text_[pos_] <= '9') {
+      ++pos_;
+    }
+    return pos_ > start;
+  }
+
+  bool consumeLiteral(std::string_view literal) {
+    if (text_.substr(pos_, literal.size()) != literal) {
+      return fail("invalid literal");
+    }
+    pos_ += literal.size();
+    return true;
+  }
+
+  void skipWhitespace() {
+    while (pos_ < text_.size() &&
+        (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r')) {
+      ++pos_;
+    }
+  }
+
+  bool fail(const std::string& message) {
+    if (error_ != nullptr) {
+      *error_ = message + " at offset " + std::to_string(pos_);
+    }
+    return false;
+  }
+
+  std::string_view text_;
+  size_t pos_;
+  std::string* error_;
+};
+
+bool parseJson(std::string_view text, JsonValue* out, std::string* error) {
+  *out = JsonValue();
+  return JsonParser(text, error).parseDocument(out);
+}
+
+bool jsonToUint64(const JsonValue& value, uint64_t* out) {
+  if (value.type() != JsonValue::Number && value.type() != JsonValue::String) {
+    return false;
+  }
+  const std::string& text = value.stringValue();
+  if (text.empty()) {
+    return false;
+  }
+  uint64_t result = 0;
+  for (const char c : text) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    const uint64_t digit = c - '0';
+    if (result > (UINT64_MAX - digit) / 10) {
+      return false;
+    }
+    result = result * 10 + digit;
+  }
+  *out = result;
+  return true;
+}
+
+}}
@@ -0,0 +1,84 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace google { namespace dlp_filter {
+
+// Minimal JSON document used to read the plugin configuration in builds that
+// link protobuf-lite only (and therefore have no JsonStringToMessage).
+//
+// Numbers are kept as their raw text, so 64-bit integers are not rounded
+// through a double.
+class JsonValue {
+ public:
+  enum Type {
+    Null,
+    Bool,
+    Number,
+    String,
+    Array,
+    Object
+  };
+
+  JsonValue() : type_(Null), bool_value_() {}
+
+  Type type() const {
+    return type_;
+  }
+
+  bool boolValue() const {
+    return bool_value_;
+  }
+
+  // Decoded value of a string, or raw text of a number.
+  const std::string& stringValue() const {
+    return string_value_;
+  }
+
+  const std::vector<JsonValue>& arrayValue() const {
+    return array_value_;
+  }
+
+  // Object members in the order they appear in the document.
+  const std::vector<std::pair<std::string, JsonValue>>& objectValue() const {
+    return object_value_;
+  }
+
+ private:
+  friend class JsonParser;
+
+  Type type_;
+  bool bool_value_;
+  std::string string_value_;
+  std::vector<JsonValue> array_value_;
+  std::vector<std::pair<std::string, JsonValue>> object_value_;
+};
+
+// Parses JSON text into out. Trailing commas in arrays and objects are
+// tolerated, matching the leniency of the protobuf JSON parser used by the
+// full build.
+// Returns false and describes the problem in error if the text is malformed.
+bool parseJson(std::string_view text, JsonValue* out, std::string* error);
+
+// Reads an unsigned integer from a number or a string holding a number, as
+// allowed for 64-bit fields by the proto3 JSON mapping.
+bool jsonToUint64(const JsonValue& value, uint64_t* out);
+
+}}
@@ -0,0 +1,109 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "endpoint_picker.h"
+
+namespace google { namespace dlp_filter {
+
+namespace {
+// Weight of the latest call in the latency moving average
+static const double LatencySmoothing = 0.2;
+}
+
+EndpointPicker::EndpointPicker(
+    const std::vector<uint32_t>& weights, Options options, uint32_t seed)
+    : options_(options),
+      generator_(seed) {
+  endpoints_.reserve(weights.size());
+  candidates_.reserve(weights.size());
+  shares_.reserve(weights.size());
+  for (uint32_t weight : weights) {
+    endpoints_.push_back({weight > 0 ? weight : 1, 0, 0, 0, 0});
+  }
+}
+
+size_t EndpointPicker::pick(uint64_t now_ns) {
+  candidates_.clear();
+  shares_.clear();
+  size_t first_returning = 0;
+  double best_latency_ns = 0;
+  for (size_t i = 0; i < endpoints_.size(); i++) {
+    const Endpoint& endpoint = endpoints_[i];
+    if (endpoint.ejected_until_ns <= now_ns) {
+      candidates_.push_back(i);
+      if (endpoint.latency_ns > 0
+          && (best_latency_ns == 0 || endpoint.latency_ns < best_latency_ns)) {
+        best_latency_ns = endpoint.latency_ns;
+      }
+    } else if (endpoint.ejected_until_ns < endpoints_[first_returning].ejected_until_ns) {
+      first_returning = i;
+    }
+  }
+
+  size_t chosen = candidates_.empty() ? first_returning : candidates_[0];
+  if (candidates_.size() > 1) {
+    // Endpoints without latency yet are assumed to be as fast as the best one.
+    const double unknown_latency_ns = best_latency_ns > 0 ? best_latency_ns : 1;
+    double total = 0;
+    for (size_t i : candidates_) {
+      const Endpoint& endpoint = endpoints_[i];
+      const double latency_ns =
+          endpoint.latency_ns > 0 ? endpoint.latency_ns : unknown_latency_ns;
+      shares_.push_back(endpoint.weight / ((endpoint.outstanding + 1) * latency_ns));
+      total += shares_.back();
+    }
+    double point = std::uniform_real_distribution<double>(0, total)(generator_);
+    for (size_t i = 0; i < candidates_.size(); i++) {
+      chosen = candidates_[i];
+      if (point < shares_[i]) {
+        break;
+      }
+      point -= shares_[i];
+    }
+  }
+  endpoints_[chosen].outstanding++;
+  return chosen;
+}
+
+bool EndpointPicker::hasAvailable(uint64_t now_ns) const {
+  for (const Endpoint& endpoint : endpoints_) {
+    if (endpoint.ejected_until_ns <= now_ns) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void EndpointPicker::onSuccess(size_t endpoint, uint64_t latency_ns) {
+  Endpoint& e = endpoints_[endpoint];
+  e.outstanding--;
+  e.consecutive_failures = 0;
+  e.latency_ns = e.latency_ns > 0
+      ? e.latency_ns + LatencySmoothing * (static_cast<double>(latency_ns) - e.latency_ns)
+      : static_cast<double>(latency_ns);
+}
+
+bool EndpointPicker::onFailure(size_t endpoint, uint64_t now_ns) {
+  Endpoint& e = endpoints_[endpoint];
+  e.outstanding--;
+  if (++e.consecutive_failures < options_.max_consecutive_failures) {
+    return false;
+  }
+  e.consecutive_failures = 0;
+  e.latency_ns = 0;
+  e.ejected_until_ns = now_ns + options_.ejection_time_ns;
+  return true;
+}
+
+}}
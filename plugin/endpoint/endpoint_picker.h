@@ -0,0 +1,81 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace google { namespace dlp_filter {
+
+// Chooses the endpoint of each call among weighted endpoints.
+//
+// Endpoints are drawn at random in proportion to
+// weight / ((outstanding calls + 1) * latency), where latency is a moving
+// average over its successful calls. Alike endpoints thus get calls in
+// proportion to their weights, while busy or slow ones get fewer, but still
+// enough to notice when they recover. An endpoint failing
+// max_consecutive_failures calls in a row is ejected for ejection_time_ns.
+//
+// Every pick() has to be followed by exactly one onSuccess() or onFailure()
+// for the returned endpoint.
+class EndpointPicker {
+ public:
+  struct Options {
+    uint32_t max_consecutive_failures;
+    uint64_t ejection_time_ns;
+  };
+
+  // Weights of 0 are treated as 1.
+  EndpointPicker(const std::vector<uint32_t>& weights, Options options, uint32_t seed);
+
+  // Index of the endpoint for a call starting at now_ns. If all endpoints
+  // are ejected, the one that is due to return first is used.
+  size_t pick(uint64_t now_ns);
+
+  void onSuccess(size_t endpoint, uint64_t latency_ns);
+
+  // Returns whether the failure got the endpoint ejected.
+  bool onFailure(size_t endpoint, uint64_t now_ns);
+
+  size_t outstanding(size_t endpoint) const {
+    return endpoints_[endpoint].outstanding;
+  }
+
+  bool isEjected(size_t endpoint, uint64_t now_ns) const {
+    return endpoints_[endpoint].ejected_until_ns > now_ns;
+  }
+
+  // Whether any endpoint is in use at now_ns.
+  bool hasAvailable(uint64_t now_ns) const;
+
+ private:
+  struct Endpoint {
+    uint32_t weight;
+    uint32_t outstanding;
+    uint32_t consecutive_failures;
+    // Moving average of call latency, 0 while unknown
+    double latency_ns;
+    uint64_t ejected_until_ns;
+  };
+
+  const Options options_;
+  std::vector<Endpoint> endpoints_;
+  // Endpoints eligible for the current pick and their shares
+  std::vector<size_t> candidates_;
+  std::vector<double> shares_;
+  std::mt19937 generator_;
+};
+
+}}
@@ -31,6 +31,7 @@ static RegisterContextFactory register_DlpContext(
 namespace {
 static constexpr char DlpServiceName[] = "google.privacy.dlp.v2.DlpService";
 static constexpr char InspectContentMethodName[] = "InspectContent";
+static constexpr char HybridInspectMethodName[] = "HybridInspectJobTrigger";
 static const int Timeout10s = 10000;
 static constexpr char DlpUri[] = "dlp.googleapis.com";
 static constexpr char DlpStat[] = "dlp_stat";
@@ -39,91 +40,507 @@ static constexpr char ParentPrefix[] = "projects/";
 static constexpr char LocationsInfix[] = "/locations/";
 static constexpr char LocationGlobalSuffix[] = "global";
 static const std::set<std::string> DefaultLabels{"app", "version"};
+static const uint32_t DefaultMaxTagValues = 50;
+static const uint32_t DefaultStatsFlushIntervalMs = 1000;
+static const uint32_t DefaultMaxConsecutiveFailures = 5;
+static const uint32_t DefaultEjectionTimeMs = 30000;
+static const uint32_t DefaultMaxBatchSize = 10;
+static const uint32_t DefaultMaxBatchDelayMs = 1000;
+// Estimated encoding overhead of a hybrid inspect table row besides its values
+static const size_t HybridRowOverhead = 32;
+static const uint64_t NanosPerMilli = 1000000;
+static const uint32_t DefaultSpoolMaxEntries = 1000;
+static const uint32_t DefaultSpoolMaxAgeMs = 60000;
+static const uint32_t DefaultSpoolDrainPerSecond = 10;
+static const uint32_t DefaultLearnedSecretsMaxEntries = 1000;
+static const uint32_t DefaultLearnedSecretsTtlMs = 3600000;
+static const uint32_t DefaultCoalesceMaxDelayMs = 5000;
+static const uint32_t DefaultEnforceDeadlineMs = 50;
+static const uint32_t DefaultEnforceStatusCode = 403;
+static constexpr char EnforceResponseDetails[] = "dlp_enforced";
+// Columns of the table sent for a coalesced stream, and the field names of
+// its URL and bodies
+static constexpr char DirectionColumn[] = "direction";
+static constexpr char FieldColumn[] = "field";
+static constexpr char ValueColumn[] = "value";
+static constexpr char UrlField[] = "url";
+static constexpr char BodyField[] = "body";
+static constexpr char HeaderFieldPrefix[] = "header.";
+// Timer period while spooling is enabled, to drain the spool smoothly
+static const uint32_t SpoolTickPeriodMs = 100;
+static constexpr char SpoolKeyPrefix[] = "dlp_spool.";
+// Operations a spooled message is to be sent to
+static const uint8_t StoreLocalOperation = 1;
+static const uint8_t HybridInspectOperation = 2;
+// Route tag value of streams not matched to a named route
+static constexpr char NoRoute[] = "none";
+// Workload tag value when the proxy has no WORKLOAD_NAME metadata
+static constexpr char NoWorkload[] = "unknown";
 
-// Number of messages sent for inspection
-static Counter<>* inspected_ = Counter<>::New("dlp_stat_inspected");
-// Number of messages not inspected (should be 0 if sampling is 100%)
-static Counter<>* not_inspected_ = Counter<>::New("dlp_stat_not_inspected");
-// Sum of all bytes sent for inspection (might differ from actually inspected
-// bytes in case there was an issue on Cloud DLP side)
-static Counter<>* total_bytes_inspected_ = Counter<>::New("dlp_stat_total_bytes_inspected");
-// Sum of all bytes that could have been sent for inspection but weren't
-// due to sampling or rpc-related issues.
-static Counter<>* total_bytes_not_inspected_ = Counter<>::New("dlp_stat_total_bytes_not_inspected");
-// When request sent to the server is too large
-static Counter<>* request_too_large_ = Counter<>::New("dlp_stat_request_too_large");
-// Any other error
-static Counter<>* filter_error_ = Counter<>::New("dlp_stat_filter_error");
-// Number of times grpc returned an error (grpc_status was different than 0)
-static Counter<>* grpc_error_ = Counter<>::New("dlp_stat_grpc_error");
-// Number of times particular grpc_status was returned
-static Counter<int>* grpc_status_ = Counter<int>::New("grpc_status", "dlp_stat_code");
-// Number of findings returned found by DLP
-static Counter<>* findings_ = Counter<>::New("dlp_stat_findings");
-
-class InspectContentCallHandler : public GrpcCallHandler<google::protobuf::Empty> {
+// Defines a counter and returns its accumulator slot
+uint32_t counterSlot(StatAccumulator* accumulator, const std::string& name) {
+  uint32_t metric_id = 0;
+  defineMetric(MetricType::Counter, name, &metric_id);
+  return accumulator->slot(metric_id);
+}
+
+// Parses a decimal header value such as content-length, UnknownSize if
+// it is missing or malformed
+uint64_t parseHeaderNumber(std::string_view value) {
+  uint64_t parsed = 0;
+  const char* end = value.data() + value.size();
+  const auto [ptr, error] = std::from_chars(value.data(), end, parsed);
+  return error == std::errc() && ptr == end ? parsed : MessageProperties::UnknownSize;
+}
+
+TaggedMetric::Resolver counterSlots(StatAccumulator* accumulator) {
+  return [accumulator](const std::string& name) {
+    return counterSlot(accumulator, name);
+  };
+}
+
+std::vector<std::string> singlePayload(std::string spool_payload) {
+  std::vector<std::string> payloads;
+  if (!spool_payload.empty()) {
+    payloads.push_back(std::move(spool_payload));
+  }
+  return payloads;
+}
+
+// Whether a call failing with the status is worth retrying later
+bool isRetryable(GrpcStatus status) {
+  return status == GrpcStatus::ResourceExhausted
+      || status == GrpcStatus::Unavailable
+      || status == GrpcStatus::DeadlineExceeded;
+}
+
+// Spools a message whose call did not go through, to send it again later, or
+// records it as not inspected. spool_payload is empty when spooling is
+// disabled.
+void spoolOrDrop(
+    DlpStats* stats, Spool* spool, const InspectedItem& item, std::string_view spool_payload) {
+  if (spool != nullptr && !spool_payload.empty()) {
+    if (spool->push(item.captured_ns, spool_payload)) {
+      stats->add(stats->spooled, 1);
+      return;
+    }
+    stats->add(stats->spool_dropped, 1);
+  }
+  stats->recordNotInspected(item.traffic_slots, item.size);
+}
+
+std::string_view directionName(Direction direction) {
+  return direction == Direction::Request ? "request" : "response";
+}
+
+// Log line of a finding in a message captured by the workload of node_info
+std::string findingLogLine(NodeInfoContainerDetails* node_info, std::string_view info_type) {
+  std::string log_line = node_info->fullPath();
+  log_line += Separator;
+  log_line += "DLP_DETECTED";
+  log_line += Separator;
+  log_line += info_type;
+  return log_line;
+}
+
+// Adds the [start, end) byte range of a finding in the captured message
+void appendRange(std::string* log_line, size_t start, size_t end) {
+  *log_line += Separator;
+  *log_line += std::to_string(start);
+  *log_line += "-";
+  *log_line += std::to_string(end);
+}
+
+// Adds the part of a coalesced stream a finding is in
+void appendRow(std::string* log_line, const InspectedRow& row) {
+  *log_line += Separator;
+  *log_line += directionName(row.direction);
+  *log_line += Separator;
+  *log_line += row.field;
+}
+
+// Handles the response of a call to Cloud DLP for a list of captured
+// messages: reports the outcome to the endpoint picker and records the
+// messages as inspected, spooled or not inspected.
+class DlpCallHandler : public GrpcCallHandler<google::protobuf::Empty> {
  public:
-  InspectContentCallHandler(
-      std::string parent,
-      size_t body_size,
-      std::shared_ptr<NodeInfoContainerDetails> local_node_info)
-      : parent_(parent),
-        inspected_body_size_(body_size),
-        local_node_info_(local_node_info) {}
+  DlpCallHandler(
+      std::string_view method_name,
+      std::string_view resource_name,
+      DlpStats* stats,
+      std::shared_ptr<EndpointPicker> endpoint_picker,
+      size_t endpoint,
+      std::vector<InspectedItem> items,
+      std::shared_ptr<Spool> spool,
+      std::vector<std::string> spool_payloads)
+      : stats_(stats),
+        method_name_(method_name),
+        resource_name_(resource_name),
+        endpoint_picker_(endpoint_picker),
+        endpoint_(endpoint),
+        items_(std::move(items)),
+        spool_(spool),
+        spool_payloads_(std::move(spool_payloads)),
+        start_ns_(getCurrentTimeNanoseconds()) {}
 
   void onSuccess(size_t body_size) override {
-    grpc_status_->record(1, static_cast<int>(GrpcStatus::Ok));
+    endpoint_picker_->onSuccess(endpoint_, getCurrentTimeNanoseconds() - start_ns_);
+    stats_->add(stats_->grpcStatus(GrpcStatus::Ok), 1);
+    for (const InspectedItem& item : items_) {
+      stats_->recordInspected(item.traffic_slots, item.size);
+    }
+    onResponse(body_size);
+  }
+
+  void onFailure(GrpcStatus status) override {
+    if (endpoint_picker_->onFailure(endpoint_, getCurrentTimeNanoseconds())) {
+      stats_->add(stats_->endpoint_ejected, 1);
+      logWarn(std::string("Ejecting DLP endpoint after consecutive failures: ") + resource_name_);
+    }
+    stats_->add(stats_->grpcStatus(status), 1);
+    stats_->add(stats_->grpc_error, 1);
+    const bool retryable = isRetryable(status) && !spool_payloads_.empty();
+    for (size_t i = 0; i < items_.size(); i++) {
+      if (retryable) {
+        spoolOrDrop(stats_, spool_.get(), items_[i], spool_payloads_[i]);
+      } else {
+        stats_->recordNotInspected(items_[i].traffic_slots, items_[i].size);
+      }
+    }
+    logWarn(method_name_ + " call to DLP failed with gRPC status code: " +
+        std::to_string(static_cast<int>(status)));
+  }
+
+ protected:
+  // Called with the size of a successful response
+  virtual void onResponse(size_t) {}
+
+  // Owned by the root context, which outlives its gRPC calls
+  DlpStats* stats_;
+
+ private:
+  std::string method_name_;
+  std::string resource_name_;
+  // Endpoint the call was sent to. The picker is shared so that it outlives
+  // calls in progress when the configuration changes.
+  std::shared_ptr<EndpointPicker> endpoint_picker_;
+  size_t endpoint_;
+  std::vector<InspectedItem> items_;
+  // Spool and the items encoded for it, empty unless spooling is enabled
+  std::shared_ptr<Spool> spool_;
+  std::vector<std::string> spool_payloads_;
+  uint64_t start_ns_;
+};
+
+// Reports the findings of an InspectContent call in stats and proxy logs, and
+// learns their quotes when enabled. The call carries either a single message
+// as a byte item, or the rows of a coalesced stream as a table.
+class InspectContentCallHandler : public DlpCallHandler {
+ public:
+  InspectContentCallHandler(
+      std::string_view parent,
+      std::shared_ptr<NodeInfoContainerDetails> local_node_info,
+      DlpStats* stats,
+      std::shared_ptr<EndpointPicker> endpoint_picker,
+      size_t endpoint,
+      std::vector<InspectedItem> items,
+      const OffsetMap& offsets,
+      std::vector<InspectedRow> rows,
+      std::shared_ptr<LearnedSecrets> learned_secrets,
+      std::shared_ptr<Spool> spool,
+      std::vector<std::string> spool_payloads)
+      : DlpCallHandler(InspectContentMethodName, parent, stats, endpoint_picker, endpoint,
+                       std::move(items), spool, std::move(spool_payloads)),
+        local_node_info_(local_node_info),
+        offsets_(offsets),
+        rows_(std::move(rows)),
+        learned_secrets_(learned_secrets) {}
+
+ protected:
+  void onResponse(size_t body_size) override {
     WasmDataPtr response_data = getBufferBytes(WasmBufferType::GrpcReceiveBuffer, 0, body_size);
-    inspected_->record(1);
-    total_bytes_inspected_->record(inspected_body_size_);
-    const InspectContentResponse& response = response_data->proto<InspectContentResponse>();
-    if (response.has_result() && response.result().findings_size() > 0) {
-      findings_->record(response.result().findings_size());
-      for (auto& finding : response.result().findings()) {
-        const std::string info_type = finding.info_type().name().data();
-        std::string log_line = local_node_info_->fullPath();
-        log_line += Separator;
-        log_line += "DLP_DETECTED";
-        log_line += Separator;
-        log_line += info_type;
-        logWarn(log_line);
+    // Findings are read in place, only their info types, locations and
+    // quotes are used here.
+    InspectContentResponseScanner scanner(response_data->data(), response_data->size());
+    FindingView finding;
+    size_t findings_count = 0;
+    const uint64_t now_ns = getCurrentTimeNanoseconds();
+    while (scanner.next(&finding)) {
+      findings_count++;
+      stats_->add(stats_->findingsByInfoType(finding.info_type), 1);
+      if (learned_secrets_ && !finding.quote.empty()) {
+        learned_secrets_->learn(finding.quote, finding.info_type, now_ns);
+      }
+      const InspectedRow* row =
+          finding.has_table_location && finding.row_index >= 0
+              && static_cast<size_t>(finding.row_index) < rows_.size()
+          ? &rows_[finding.row_index]
+          : nullptr;
+      // Ranges in table rows are relative to the cell.
+      const OffsetMap& offsets =
+          row != nullptr && finding.field == ValueColumn ? row->offsets : offsets_;
+      std::string log_line = findingLogLine(local_node_info_.get(), finding.info_type);
+      // Offsets in a value whose invalid UTF-8 was replaced no longer match
+      // the message, so its findings are logged without a location.
+      if (finding.has_byte_range && (&offsets == &offsets_ || row->located)) {
+        // Locations in the original message, before minimization
+        appendRange(&log_line, offsets.original(finding.byte_range_start),
+                    offsets.originalEnd(finding.byte_range_end));
+      }
+      if (row != nullptr) {
+        appendRow(&log_line, *row);
       }
+      logWarn(log_line);
+    }
+    if (scanner.malformed()) {
+      stats_->add(stats_->filter_error, 1);
+      logWarn("Cannot parse InspectContent response from DLP");
+    }
+    if (findings_count > 0) {
+      stats_->add(stats_->findings, findings_count);
     } else {
       std::string log_line = local_node_info_->fullPath();
       log_line += Separator;
       log_line += "DLP_NOT_DETECTED";
       logWarn(log_line);
     }
+    onInspected(findings_count, scanner.malformed());
   }
 
+  // Called once the findings of a successful call were reported
+  virtual void onInspected(size_t, bool) {}
+
+ private:
+  std::shared_ptr<NodeInfoContainerDetails> local_node_info_;
+  // Maps finding locations back to the captured message
+  OffsetMap offsets_;
+  // Rows of the table sent for a coalesced stream, by row index
+  std::vector<InspectedRow> rows_;
+  // Learns the quotes of findings, unset unless enabled
+  std::shared_ptr<LearnedSecrets> learned_secrets_;
+};
+
+// Inspects an enforced response, and delivers the verdict to its stream. The
+// call runs to completion even past the enforcement deadline, so that its
+// findings are still reported.
+class EnforcedInspectCallHandler : public InspectContentCallHandler {
+ public:
+  EnforcedInspectCallHandler(
+      std::string_view parent,
+      std::shared_ptr<NodeInfoContainerDetails> local_node_info,
+      DlpStats* stats,
+      std::shared_ptr<EndpointPicker> endpoint_picker,
+      size_t endpoint,
+      const InspectedItem& item,
+      const OffsetMap& offsets,
+      std::shared_ptr<LearnedSecrets> learned_secrets,
+      DlpRootContext* root,
+      uint32_t context_id)
+      : InspectContentCallHandler(parent, local_node_info, stats, endpoint_picker, endpoint,
+                                  {item}, offsets, {}, learned_secrets, nullptr, {}),
+        root_(root),
+        context_id_(context_id) {}
+
   void onFailure(GrpcStatus status) override {
-    std::function<void(GrpcStatus status, size_t body_size)> callback =
-        [&](GrpcStatus status, size_t body_size) {
-          grpc_status_->record(1, static_cast<int>(status));
-          WasmDataPtr
-              response_data = getBufferBytes(WasmBufferType::GrpcReceiveBuffer, 0, body_size);
-          not_inspected_->record(1);
-          total_bytes_not_inspected_->record(inspected_body_size_);
-          grpc_error_->record(1);
-          logWarn(std::string("InspectContent call to DLP failed with gRPC status code: ") +
-              std::to_string(static_cast<int>(status)));
-        };
+    InspectContentCallHandler::onFailure(status);
+    root_->deliverVerdict(context_id_, Verdict::Failed);
+  }
+
+ protected:
+  void onInspected(size_t findings_count, bool malformed) override {
+    if (findings_count > 0) {
+      root_->deliverVerdict(context_id_, Verdict::Findings);
+    } else {
+      root_->deliverVerdict(context_id_, malformed ? Verdict::Failed : Verdict::Clean);
+    }
   }
 
  private:
-  std::string parent_;
-  size_t inspected_body_size_;
-  std::shared_ptr<NodeInfoContainerDetails> local_node_info_;
+  DlpRootContext* root_;
+  uint32_t context_id_;
 };
+
+// Proxy-wasm shared data, shared by the VMs of all workers
+class SharedDataStore : public SharedStore {
+ public:
+  bool get(std::string_view key, std::string* value, uint32_t* cas) override {
+    WasmDataPtr data;
+    if (getSharedData(key, &data, cas) != WasmResult::Ok) {
+      return false;
+    }
+    if (data) {
+      value->assign(data->data(), data->size());
+    } else {
+      value->clear();
+    }
+    return true;
+  }
+
+  bool set(std::string_view key, std::string_view value, uint32_t cas) override {
+    return setSharedData(key, value, cas) == WasmResult::Ok;
+  }
+};
+
+SharedDataStore shared_data_store;
+
+// Serializes the GrpcService of a Cloud DLP endpoint, using the default
+// endpoint when no configuration is given.
+bool serializeGrpcService(const GrpcService_GoogleGrpc* config, std::string* out) {
+  GrpcService grpc_service;
+  GrpcService_GoogleGrpc* google_grpc = grpc_service.mutable_google_grpc();
+  if (config != nullptr) {
+    google_grpc->MergeFrom(*config);
+  } else {
+    google_grpc->set_target_uri(DlpUri);
+    google_grpc->mutable_channel_credentials()->mutable_google_default();
+    google_grpc->set_stat_prefix(DlpStat);
+  }
+  return grpc_service.SerializeToString(out);
+}
+}
+
+DlpStats::DlpStats(
+    StatAccumulator* accumulator, size_t max_tag_values, std::string_view workload)
+    : inspected(counterSlot(accumulator, "dlp_stat_inspected")),
+      not_inspected(counterSlot(accumulator, "dlp_stat_not_inspected")),
+      total_bytes_inspected(counterSlot(accumulator, "dlp_stat_total_bytes_inspected")),
+      total_bytes_not_inspected(counterSlot(accumulator, "dlp_stat_total_bytes_not_inspected")),
+      total_bytes_saved(counterSlot(accumulator, "dlp_stat_total_bytes_saved")),
+      request_too_large(counterSlot(accumulator, "dlp_stat_request_too_large")),
+      filter_error(counterSlot(accumulator, "dlp_stat_filter_error")),
+      grpc_error(counterSlot(accumulator, "dlp_stat_grpc_error")),
+      findings(counterSlot(accumulator, "dlp_stat_findings")),
+      endpoint_ejected(counterSlot(accumulator, "dlp_stat_endpoint_ejected")),
+      throttled(counterSlot(accumulator, "dlp_stat_throttled")),
+      learned_matches(counterSlot(accumulator, "dlp_stat_learned_matches")),
+      coalesced(counterSlot(accumulator, "dlp_stat_coalesced")),
+      enforce_blocked(counterSlot(accumulator, "dlp_stat_enforce_blocked")),
+      enforce_deadline_expired(counterSlot(accumulator, "dlp_stat_enforce_deadline_expired")),
+      spooled(counterSlot(accumulator, "dlp_stat_spooled")),
+      spool_dropped(counterSlot(accumulator, "dlp_stat_spool_dropped")),
+      spool_resent(counterSlot(accumulator, "dlp_stat_spool_resent")),
+      spool_expired(counterSlot(accumulator, "dlp_stat_spool_expired")),
+      accumulator_(accumulator),
+      spool_entries_(0),
+      spool_bytes_(0),
+      spool_oldest_age_ms_(0),
+      enforce_latency_ms_(0),
+      route_("route", max_tag_values),
+      direction_("direction", 2),
+      workload_("workload", 1),
+      info_type_("info_type", max_tag_values),
+      capture_rule_("capture_rule", max_tag_values),
+      direction_indices_{direction_.index("request"), direction_.index("response")},
+      workload_index_(workload_.index(workload.empty() ? std::string_view(NoWorkload) : workload)),
+      tagged_inspected_("dlp_stat_inspected", {&route_, &direction_, &workload_},
+                        counterSlots(accumulator)),
+      tagged_bytes_inspected_("dlp_stat_total_bytes_inspected",
+                              {&route_, &direction_, &workload_}, counterSlots(accumulator)),
+      tagged_not_inspected_("dlp_stat_not_inspected", {&route_, &direction_, &workload_},
+                            counterSlots(accumulator)),
+      tagged_bytes_not_inspected_("dlp_stat_total_bytes_not_inspected",
+                                  {&route_, &direction_, &workload_}, counterSlots(accumulator)),
+      tagged_bytes_saved_("dlp_stat_total_bytes_saved", {&route_, &direction_, &workload_},
+                          counterSlots(accumulator)),
+      tagged_findings_("dlp_stat_findings", {&info_type_}, counterSlots(accumulator)),
+      tagged_capture_rule_matched_("dlp_stat_capture_rule_matched", {&capture_rule_},
+                                   counterSlots(accumulator)),
+      tagged_capture_rule_bytes_skipped_("dlp_stat_capture_rule_bytes_skipped",
+                                         {&capture_rule_}, counterSlots(accumulator)) {}
+
+void DlpStats::recordInspected(const TrafficSlots& traffic_slots, size_t size) {
+  add(inspected, 1);
+  add(total_bytes_inspected, size);
+  add(traffic_slots.inspected, 1);
+  add(traffic_slots.bytes_inspected, size);
+}
+
+void DlpStats::recordNotInspected(const TrafficSlots& traffic_slots, size_t size) {
+  add(not_inspected, 1);
+  add(total_bytes_not_inspected, size);
+  add(traffic_slots.not_inspected, 1);
+  add(traffic_slots.bytes_not_inspected, size);
+}
+
+void DlpStats::recordSaved(const TrafficSlots& traffic_slots, size_t size) {
+  add(total_bytes_saved, size);
+  add(traffic_slots.bytes_saved, size);
+}
+
+void DlpStats::recordSpoolDepth(const Spool::Depth& depth) {
+  if (spool_entries_ == 0) {
+    defineMetric(MetricType::Gauge, "dlp_stat_spool_entries", &spool_entries_);
+    defineMetric(MetricType::Gauge, "dlp_stat_spool_bytes", &spool_bytes_);
+    defineMetric(MetricType::Gauge, "dlp_stat_spool_oldest_age_ms", &spool_oldest_age_ms_);
+  }
+  recordMetric(spool_entries_, depth.entries);
+  recordMetric(spool_bytes_, depth.bytes);
+  recordMetric(spool_oldest_age_ms_, depth.oldest_age_ns / NanosPerMilli);
+}
+
+void DlpStats::recordEnforceLatency(uint64_t latency_ns) {
+  if (enforce_latency_ms_ == 0) {
+    defineMetric(MetricType::Histogram, "dlp_stat_enforce_latency_ms", &enforce_latency_ms_);
+  }
+  recordMetric(enforce_latency_ms_, latency_ns / NanosPerMilli);
+}
+
+DlpStats::TrafficSlots DlpStats::traffic(std::string_view route, Direction direction) {
+  const uint16_t route_index = route_.index(route.empty() ? std::string_view(NoRoute) : route);
+  const uint16_t direction_index = direction_indices_[static_cast<int>(direction)];
+  return {
+      tagged_inspected_.id({route_index, direction_index, workload_index_}),
+      tagged_bytes_inspected_.id({route_index, direction_index, workload_index_}),
+      tagged_not_inspected_.id({route_index, direction_index, workload_index_}),
+      tagged_bytes_not_inspected_.id({route_index, direction_index, workload_index_}),
+      tagged_bytes_saved_.id({route_index, direction_index, workload_index_}),
+  };
+}
+
+uint32_t DlpStats::findingsByInfoType(std::string_view info_type) {
+  return tagged_findings_.id({info_type_.index(info_type)});
+}
+
+DlpStats::CaptureRuleSlots DlpStats::captureRule(std::string_view name) {
+  const uint16_t rule_index = capture_rule_.index(name);
+  return {
+      tagged_capture_rule_matched_.id({rule_index}),
+      tagged_capture_rule_bytes_skipped_.id({rule_index}),
+  };
+}
+
+// Named like the SDK's Counter<int>("grpc_status", "dlp_stat_code") it replaces.
+uint32_t DlpStats::grpcStatus(GrpcStatus status) {
+  const int code = static_cast<int>(status);
+  auto it = grpc_status_slots_.find(code);
+  if (it != grpc_status_slots_.end()) {
+    return it->second;
+  }
+  const uint32_t slot =
+      counterSlot(accumulator_, "dlp_stat_code." + std::to_string(code) + ".grpc_status");
+  grpc_status_slots_.emplace(code, slot);
+  return slot;
 }
 
 // Loads WASM configuration
 bool DlpRootContext::onConfigure(size_t config_size) {
   // Load filter config
   logInfo("Starting onConfigure");
+  // Messages batched or deferred under the previous configuration are sent
+  // with it.
+  flushHybridBatch();
+  releaseRequests(UINT64_MAX);
   const WasmDataPtr
       configuration = getBufferBytes(WasmBufferType::PluginConfiguration, 0, config_size);
-  JsonParseOptions json_options;
+#ifdef PROXY_WASM_PROTOBUF_LITE
+  std::string parse_error;
+  if (!google::dlp_filter::parsePluginConfig(configuration->view(), &config_, &parse_error)) {
+    logWarn("Cannot parse plugin configuration JSON string (" + parse_error + "): "
+                + configuration->toString());
+    return false;
+  }
+#else
+  google::protobuf::util::JsonParseOptions json_options;
   const Status options_status = JsonStringToMessage(
       configuration->toString(),
       &config_,
@@ -131,7 +548,9 @@ bool DlpRootContext::onConfigure(size_t config_size) {
   if (options_status != Status::OK) {
     logWarn("Cannot parse plugin configuration JSON string: " + configuration->toString());
     return false;
-  } else if (!config_.has_inspect()) {
+  }
+#endif
+  if (!config_.has_inspect()) {
     logWarn("Missing inspect configuration: " + configuration->toString());
     return false;
   } else if (!config_.inspect().has_destination()) {
@@ -140,7 +559,9 @@ bool DlpRootContext::onConfigure(size_t config_size) {
   } else if (!config_.inspect().destination().has_operation()) {
     logWarn("Missing operation configuration: " + configuration->toString());
     return false;
-  } else if (!config_.inspect().destination().operation().has_store_local()) {
+  }
+  const ::dlp::DestinationOperation& operation = config_.inspect().destination().operation();
+  if (!operation.has_store_local() && !operation.has_hybrid_inspect()) {
     logWarn("At least one operation type has to be defined: " + configuration->toString());
     return false;
   }
@@ -148,21 +569,18 @@ bool DlpRootContext::onConfigure(size_t config_size) {
   // With this configuration, from user perspective, findings are stored locally in proxy logs.
   // Technically we call inspect content operation and write the findings from the response into
   // logs.
-  const ::dlp::StoreFindingsLocally& local_config =
-      config_.inspect().destination().operation().store_local();
-  if (local_config.project_id().empty()) {
+  if (operation.has_store_local() && operation.store_local().project_id().empty()) {
     logWarn("Missing project_id: " + configuration->toString());
     return false;
   }
-  std::string parent = std::string(ParentPrefix);
-  parent += local_config.project_id();
-  parent += LocationsInfix;
-  if (local_config.location_id().empty()) {
-    parent += LocationGlobalSuffix;
-  } else {
-    parent += local_config.location_id();
+  if (operation.has_hybrid_inspect() && operation.hybrid_inspect().job_trigger_name().empty()) {
+    logWarn("Missing job_trigger_name: " + configuration->toString());
+    return false;
+  }
+  if (!createEndpoints()) {
+    logWarn("Cannot load destination endpoints: " + configuration->toString());
+    return false;
   }
-  parent_ = parent;
 
   const Status sampler_status = createSampler();
   if (sampler_status != Status::OK) {
@@ -178,25 +596,314 @@ bool DlpRootContext::onConfigure(size_t config_size) {
     logWarn("Cannot load NodeInfo: " + node_info_status.error_message().as_string());
     return false;
   }
+  createStats();
+  if (!createCaptureRules()) {
+    return false;
+  }
+  createHybridInspect();
+  createSpool();
+  createMinimizer();
+  createLearnedSecrets();
+  createCoalescing();
+  createEnforcement();
+  const ::dlp::RateLimit& rate_limit = config_.inspect().rate_limit();
+  rate_limiter_ = std::make_unique<TokenBucket>(
+      rate_limit.calls_per_second(),
+      rate_limit.burst() > 0 ? rate_limit.burst() : rate_limit.calls_per_second());
 
-  // Prepare grpc_service string to be used in grpc call
-  GrpcService grpc_service;
-  GrpcService_GoogleGrpc* google_grpc = grpc_service.mutable_google_grpc();
-  if (config_.inspect().destination().has_grpc_config()) {
-    google_grpc->MergeFrom(config_.inspect().destination().grpc_config());
-  } else {
-    google_grpc->set_target_uri(DlpUri);
-    google_grpc->mutable_channel_credentials()->mutable_google_default();
-    google_grpc->set_stat_prefix(DlpStat);
+  // Ticks flush buffered stats and send hybrid inspect batches that are due.
+  uint32_t tick_period_ms = 0;
+  if (stat_accumulator_->buffered()) {
+    const uint32_t flush_interval_ms = config_.inspect().stats().flush_interval_ms();
+    tick_period_ms = flush_interval_ms > 0 ? flush_interval_ms : DefaultStatsFlushIntervalMs;
   }
-  if (!grpc_service.SerializeToString(&grpc_service_string_)) {
-    logWarn("Cannot serialize service config to string.");
-    return false;
+  if (operation.has_hybrid_inspect()) {
+    const uint32_t max_batch_delay_ms = operation.hybrid_inspect().max_batch_delay_ms() > 0
+        ? operation.hybrid_inspect().max_batch_delay_ms()
+        : DefaultMaxBatchDelayMs;
+    tick_period_ms = tick_period_ms > 0
+        ? std::min(tick_period_ms, max_batch_delay_ms)
+        : max_batch_delay_ms;
+  }
+  if (spool_) {
+    tick_period_ms = tick_period_ms > 0
+        ? std::min(tick_period_ms, SpoolTickPeriodMs)
+        : SpoolTickPeriodMs;
+  }
+  if (coalesced_table_) {
+    const uint32_t max_delay_ms = config_.inspect().coalesce().max_delay_ms() > 0
+        ? config_.inspect().coalesce().max_delay_ms()
+        : DefaultCoalesceMaxDelayMs;
+    tick_period_ms = tick_period_ms > 0 ? std::min(tick_period_ms, max_delay_ms) : max_delay_ms;
   }
+  if (!enforced_routes_.empty()) {
+    // Held responses expire at most half a deadline late.
+    const uint32_t deadline_ms = enforceConfig().deadline_ms() > 0
+        ? enforceConfig().deadline_ms()
+        : DefaultEnforceDeadlineMs;
+    const uint32_t expiry_period_ms = std::max(deadline_ms / 2, 1u);
+    tick_period_ms = tick_period_ms > 0
+        ? std::min(tick_period_ms, expiry_period_ms)
+        : expiry_period_ms;
+  }
+  proxy_set_tick_period_milliseconds(tick_period_ms);
+
   logDebug("Configuration successful.");
   return true;
 }
 
+// Prepares the endpoints calls of all operations are spread over: those
+// listed in the destination, or the single one configured by grpc_config
+// otherwise.
+bool DlpRootContext::createEndpoints() {
+  const ::dlp::Destination& destination = config_.inspect().destination();
+  const ::dlp::StoreFindingsLocally& local_config = destination.operation().store_local();
+  std::vector<DlpEndpoint> endpoints;
+  std::vector<uint32_t> weights;
+  const int endpoint_count = std::max(1, destination.endpoints_size());
+  for (int i = 0; i < endpoint_count; i++) {
+    const ::dlp::Endpoint* endpoint_config =
+        destination.endpoints_size() > 0 ? &destination.endpoints(i) : nullptr;
+    const GrpcService_GoogleGrpc* grpc_config = endpoint_config != nullptr
+        ? &endpoint_config->grpc_config()
+        : (destination.has_grpc_config() ? &destination.grpc_config() : nullptr);
+    const std::string& location_id =
+        endpoint_config != nullptr && !endpoint_config->location_id().empty()
+            ? endpoint_config->location_id()
+            : local_config.location_id();
+
+    DlpEndpoint endpoint;
+    // Prepare grpc_service string to be used in grpc call
+    if (!serializeGrpcService(grpc_config, &endpoint.grpc_service)) {
+      logWarn("Cannot serialize service config to string.");
+      return false;
+    }
+    endpoint.parent = ParentPrefix;
+    endpoint.parent += local_config.project_id();
+    endpoint.parent += LocationsInfix;
+    endpoint.parent += location_id.empty() ? LocationGlobalSuffix : location_id;
+    if (destination.operation().has_store_local()) {
+      endpoint.request_encoder = std::make_unique<InspectContentRequestEncoder>(
+          endpoint.parent, local_config.inspect_template_name(), location_id,
+          config_.inspect().has_learned_secrets());
+      // Requests are then encoded without allocating.
+      endpoint.request_encoder->reserve(getMaxRequestSize());
+    }
+    endpoints.push_back(std::move(endpoint));
+    weights.push_back(endpoint_config != nullptr ? endpoint_config->weight() : 1);
+  }
+
+  const EndpointPicker::Options options{
+      destination.max_consecutive_failures() > 0
+          ? destination.max_consecutive_failures()
+          : DefaultMaxConsecutiveFailures,
+      (destination.ejection_time_ms() > 0
+          ? destination.ejection_time_ms()
+          : DefaultEjectionTimeMs) * NanosPerMilli,
+  };
+  endpoints_ = std::move(endpoints);
+  endpoint_picker_ = std::make_shared<EndpointPicker>(
+      weights, options, static_cast<uint32_t>(getCurrentTimeNanoseconds()));
+  return true;
+}
+
+// Stats are created once per root context: in-flight gRPC calls keep pointers
+// to them, and captured messages keep slots of the accumulator. Their config
+// is only read on the first configuration.
+void DlpRootContext::createStats() {
+  if (stats_) {
+    return;
+  }
+  const ::dlp::StatsConfig& stats_config = config_.inspect().stats();
+  const bool buffered = !stats_config.record_immediately();
+  stat_accumulator_ = std::make_unique<StatAccumulator>(
+      [](uint32_t metric_id, uint64_t value) {
+        incrementMetric(metric_id, value);
+      },
+      buffered);
+  stats_ = std::make_unique<DlpStats>(
+      stat_accumulator_.get(),
+      stats_config.max_tag_values() > 0 ? stats_config.max_tag_values() : DefaultMaxTagValues,
+      local_node_info_->workloadName());
+  last_stats_flush_ns_ = getCurrentTimeNanoseconds();
+}
+
+// Compiles the capture rules once, so that streams only evaluate them
+bool DlpRootContext::createCaptureRules() {
+  CaptureRules capture_rules;
+  std::vector<DlpStats::CaptureRuleSlots> capture_rule_slots;
+  const auto& rule_configs = config_.inspect().capture_rules();
+  for (int i = 0; i < rule_configs.size(); i++) {
+    const ::dlp::CaptureRule& rule_config = rule_configs[i];
+    CaptureRules::Rule rule;
+    rule.action = rule_config.action() == ::dlp::CaptureRule_Action_SKIP
+        ? CaptureRules::Action::Skip
+        : CaptureRules::Action::Capture;
+    switch (rule_config.direction()) {
+      case ::dlp::CaptureRule_Direction_REQUEST:rule.directions = CaptureRules::Request;
+        break;
+      case ::dlp::CaptureRule_Direction_RESPONSE:rule.directions = CaptureRules::Response;
+        break;
+      default:rule.directions = CaptureRules::Request | CaptureRules::Response;
+    }
+    rule.methods.assign(rule_config.methods().begin(), rule_config.methods().end());
+    rule.path_prefixes.assign(
+        rule_config.path_prefixes().begin(), rule_config.path_prefixes().end());
+    rule.path_patterns.assign(
+        rule_config.path_patterns().begin(), rule_config.path_patterns().end());
+    rule.hosts.assign(rule_config.hosts().begin(), rule_config.hosts().end());
+    rule.content_types.assign(
+        rule_config.content_types().begin(), rule_config.content_types().end());
+    rule.min_status = rule_config.min_status();
+    rule.max_status = rule_config.max_status();
+    rule.min_body_bytes = rule_config.min_body_bytes();
+    rule.max_body_bytes = rule_config.max_body_bytes();
+    std::string error;
+    if (!capture_rules.add(rule, &error)) {
+      logWarn("Invalid capture rule " + std::to_string(i) + ": " + error);
+      return false;
+    }
+    capture_rule_slots.push_back(stats_->captureRule(
+        rule_config.name().empty() ? "rule_" + std::to_string(i) : rule_config.name()));
+  }
+  capture_rules_ = std::move(capture_rules);
+  capture_rule_slots_ = std::move(capture_rule_slots);
+  return true;
+}
+
+void DlpRootContext::createHybridInspect() {
+  const ::dlp::DestinationOperation& operation = config_.inspect().destination().operation();
+  if (!operation.has_hybrid_inspect()) {
+    hybrid_request_encoder_.reset();
+    hybrid_batch_.reset();
+    return;
+  }
+  hybrid_request_encoder_ = std::make_unique<HybridInspectRequestEncoder>(
+      operation.hybrid_inspect().job_trigger_name());
+  hybrid_batch_ = std::make_unique<TableEncoder>(
+      std::vector<std::string>{"route", "direction", "content"});
+}
+
+// The spool is kept in shared data under the root id, so it survives
+// reconfiguration and is shared by the workers of the same filter.
+void DlpRootContext::createSpool() {
+  const ::dlp::SpoolConfig& spool_config = config_.inspect().spool();
+  if (spool_config.max_bytes() == 0) {
+    spool_.reset();
+    return;
+  }
+  const Spool::Options options{
+      spool_config.max_bytes(),
+      spool_config.max_entries() > 0 ? spool_config.max_entries() : DefaultSpoolMaxEntries,
+      (spool_config.max_age_ms() > 0 ? spool_config.max_age_ms() : DefaultSpoolMaxAgeMs)
+          * NanosPerMilli,
+      spool_config.drain_per_second() > 0
+          ? spool_config.drain_per_second()
+          : DefaultSpoolDrainPerSecond,
+  };
+  spool_ = std::make_shared<Spool>(
+      &shared_data_store, SpoolKeyPrefix + std::string(root_id()) + ".", options);
+  spool_->init();
+}
+
+void DlpRootContext::createMinimizer() {
+  const ::dlp::MinimizeConfig& minimize_config = config_.inspect().minimize();
+  const Minimizer::Options options{
+      minimize_config.collapse_whitespace(), minimize_config.max_run_bytes()};
+  if (Minimizer(options).enabled()) {
+    minimizer_ = std::make_unique<Minimizer>(options);
+  } else {
+    minimizer_.reset();
+  }
+}
+
+// Values learned from earlier findings are kept per worker, and forgotten on
+// reconfiguration.
+void DlpRootContext::createLearnedSecrets() {
+  if (!config_.inspect().has_learned_secrets()) {
+    learned_secrets_.reset();
+    return;
+  }
+  const ::dlp::LearnedSecretsConfig& learned_config = config_.inspect().learned_secrets();
+  const LearnedSecrets::Options options{
+      learned_config.max_entries() > 0
+          ? learned_config.max_entries()
+          : DefaultLearnedSecretsMaxEntries,
+      (learned_config.ttl_ms() > 0 ? learned_config.ttl_ms() : DefaultLearnedSecretsTtlMs)
+          * NanosPerMilli,
+  };
+  learned_secrets_ = std::make_shared<LearnedSecrets>(options, getCurrentTimeNanoseconds() ^ id());
+}
+
+// Requests are only held for StoreFindingsLocally, the operation that sends
+// messages one per call.
+void DlpRootContext::createCoalescing() {
+  if (!config_.inspect().has_coalesce()
+      || !config_.inspect().destination().operation().has_store_local()) {
+    coalesced_table_.reset();
+    return;
+  }
+  coalesced_table_ = std::make_unique<TableEncoder>(
+      std::vector<std::string>{DirectionColumn, FieldColumn, ValueColumn});
+}
+
+// Responses are only held for StoreFindingsLocally, the operation whose calls
+// return findings.
+void DlpRootContext::createEnforcement() {
+  enforced_routes_.clear();
+  if (config_.inspect().destination().operation().has_store_local()) {
+    enforced_routes_.insert(
+        config_.inspect().enforce().routes().begin(), config_.inspect().enforce().routes().end());
+  }
+}
+
+// Reports stats accumulated since the previous tick, sends the hybrid
+// inspect batch once its oldest message waited max_batch_delay_ms, sends the
+// requests that waited max_delay_ms for their response, expires the held
+// responses past their deadline and drains the spool. Ticks can be shorter
+// than flush_interval_ms for these, stats are only flushed once it passed.
+void DlpRootContext::onTick() {
+  if (spool_) {
+    drainSpool();
+  }
+  if (!deferred_requests_.empty()) {
+    releaseRequests(getCurrentTimeNanoseconds());
+  }
+  if (!held_responses_.empty()) {
+    expireHeldResponses(getCurrentTimeNanoseconds());
+  }
+  if (!hybrid_batch_items_.empty()) {
+    const uint32_t max_batch_delay_ms =
+        config_.inspect().destination().operation().hybrid_inspect().max_batch_delay_ms();
+    const uint64_t max_batch_delay_ns =
+        (max_batch_delay_ms > 0 ? max_batch_delay_ms : DefaultMaxBatchDelayMs) * NanosPerMilli;
+    if (getCurrentTimeNanoseconds() - hybrid_batch_start_ns_ >= max_batch_delay_ns) {
+      flushHybridBatch();
+    }
+  }
+  if (stat_accumulator_->buffered()) {
+    const uint32_t flush_interval_ms = config_.inspect().stats().flush_interval_ms();
+    const uint64_t flush_interval_ns =
+        (flush_interval_ms > 0 ? flush_interval_ms : DefaultStatsFlushIntervalMs) * NanosPerMilli;
+    const uint64_t now_ns = getCurrentTimeNanoseconds();
+    if (now_ns - last_stats_flush_ns_ >= flush_interval_ns) {
+      stat_accumulator_->flush();
+      last_stats_flush_ns_ = now_ns;
+    }
+  }
+}
+
+// Sends batched and deferred messages and reports remaining stats so that
+// counts are exact when the VM shuts down
+bool DlpRootContext::onDone() {
+  flushHybridBatch();
+  releaseRequests(UINT64_MAX);
+  if (stat_accumulator_) {
+    stat_accumulator_->flush();
+  }
+  return true;
+}
+
 Status DlpRootContext::createSampler() {
   if (config_.inspect().has_sampling()
       && config_.inspect().sampling().has_probability()) {
@@ -250,73 +957,527 @@ Status DlpRootContext::extractPartialLocalNodeInfo(
   return Status::OK;
 }
 
-std::string DlpRootContext::getFormattedLabel(const std::string& label) {
-  int len = std::min(static_cast<unsigned long>(63), label.length());
-  std::string canonical_label = label.substr(0, len);
-  if (len > 0 && !std::isalpha(canonical_label[0])) {
-    canonical_label[0] = 'x';
+// Sends a captured message to every configured operation, unless it is
+// sampled out. A response whose request was deferred is inspected along with
+// it, unless both together exceed the maximum request size.
+void DlpRootContext::inspect(std::string_view body, Direction direction, std::string_view route,
+                             uint32_t context_id) {
+  const InspectedItem item{
+      stats_->traffic(route, direction), body.size(), getCurrentTimeNanoseconds()};
+  if (!sampler_->sample()) {
+    stats_->recordNotInspected(item.traffic_slots, item.size);
+    releaseRequest(context_id);
+    return;
   }
-  std::for_each(canonical_label.begin(), canonical_label.end(), [](char& c) {
-    if (std::isupper(c)) {
-      c = std::tolower(c);
+  auto deferred = deferred_requests_.find(context_id);
+  if (deferred != deferred_requests_.end()
+      && deferred->second.body.size() + body.size() > getMaxRequestSize()) {
+    releaseRequest(context_id);
+    deferred = deferred_requests_.end();
+  }
+  const bool coalesced = deferred != deferred_requests_.end();
+  if (coalesced) {
+    stats_->add(stats_->coalesced, 1);
+    inspectCoalesced(
+        deferred->second, body, &item, spoolPayload(StoreLocalOperation, body, direction, route));
+    deferred_requests_.erase(deferred);
+    if (!hybrid_batch_) {
+      return;
     }
-    if (!(std::isalnum(c) || c == '_' || c == '-')) {
-      c = '_';
+  }
+  // Messages are spooled as captured, and minimized again when resent. A
+  // coalesced message was minimized for its call already.
+  const std::string_view content = coalesced ? minimizeAgain(body) : minimize(body, item);
+  if (config_.inspect().destination().operation().has_store_local() && !coalesced) {
+    inspectContent(
+        content, offsets_, item, spoolPayload(StoreLocalOperation, body, direction, route));
+  }
+  if (hybrid_batch_) {
+    addToHybridBatch(content, direction, route, item,
+                     spoolPayload(HybridInspectOperation, body, direction, route));
+  }
+}
+
+// Requests are sampled, and sent to HybridInspect, when captured.
+void DlpRootContext::deferRequest(uint32_t context_id, std::string_view body,
+                                  std::string_view route, std::vector<RequestField> fields) {
+  const InspectedItem item{
+      stats_->traffic(route, Direction::Request), body.size(), getCurrentTimeNanoseconds()};
+  if (!sampler_->sample()) {
+    stats_->recordNotInspected(item.traffic_slots, item.size);
+    return;
+  }
+  if (hybrid_batch_) {
+    addToHybridBatch(minimize(body, item), Direction::Request, route, item,
+                     spoolPayload(HybridInspectOperation, body, Direction::Request, route));
+  }
+  const uint32_t max_delay_ms = config_.inspect().coalesce().max_delay_ms();
+  deferred_requests_[context_id] = DeferredRequest{
+      item, std::string(route), std::string(body), std::move(fields),
+      item.captured_ns + (max_delay_ms > 0 ? max_delay_ms : DefaultCoalesceMaxDelayMs)
+          * NanosPerMilli,
+      hybrid_batch_ != nullptr};
+}
+
+void DlpRootContext::releaseRequest(uint32_t context_id) {
+  auto deferred = deferred_requests_.find(context_id);
+  if (deferred != deferred_requests_.end()) {
+    inspectCoalesced(deferred->second, {}, nullptr, {});
+    deferred_requests_.erase(deferred);
+  }
+}
+
+// Inspects alone the requests that have been waiting since before now_ns
+void DlpRootContext::releaseRequests(uint64_t now_ns) {
+  for (auto deferred = deferred_requests_.begin(); deferred != deferred_requests_.end();) {
+    if (deferred->second.deadline_ns <= now_ns) {
+      inspectCoalesced(deferred->second, {}, nullptr, {});
+      deferred = deferred_requests_.erase(deferred);
+    } else {
+      ++deferred;
     }
-  });
-  return canonical_label;
+  }
 }
 
-void DlpRootContext::inspect(Buffer* buffer) {
-  inspectContent(buffer);
+// Enforced responses are always inspected, and sent to HybridInspect too. A
+// request deferred by the stream is sent alone, so that the response is
+// inspected in the smallest call.
+Verdict DlpRootContext::enforce(
+    std::string_view body, std::string_view route, DlpContext* context) {
+  const InspectedItem item{
+      stats_->traffic(route, Direction::Response), body.size(), getCurrentTimeNanoseconds()};
+  releaseRequest(context->id());
+  const std::string_view content = minimize(body, item);
+  if (hybrid_batch_) {
+    addToHybridBatch(content, Direction::Response, route, item,
+                     spoolPayload(HybridInspectOperation, body, Direction::Response, route));
+  }
+  if (reportLearnedSecrets(content, offsets_, item)) {
+    return Verdict::Findings;
+  }
+  // Throttled responses are not spooled: their verdict would come too late.
+  if (!acquireCall(item, std::string_view())) {
+    return Verdict::Failed;
+  }
+  const size_t endpoint_index = endpoint_picker_->pick(getCurrentTimeNanoseconds());
+  DlpEndpoint& endpoint = endpoints_[endpoint_index];
+  const std::string_view request = endpoint.request_encoder->encode(content.data(), content.size());
+  const bool started = callInspectContent(
+      endpoint_index,
+      request,
+      std::make_unique<EnforcedInspectCallHandler>(
+          endpoint.parent,
+          local_node_info_,
+          stats_.get(),
+          endpoint_picker_,
+          endpoint_index,
+          item,
+          offsets_,
+          learned_secrets_,
+          this,
+          context->id()),
+      {item});
+  if (!started) {
+    return Verdict::Failed;
+  }
+  const uint32_t deadline_ms = enforceConfig().deadline_ms();
+  held_responses_[context->id()] = {
+      context,
+      item.captured_ns + (deadline_ms > 0 ? deadline_ms : DefaultEnforceDeadlineMs) * NanosPerMilli};
+  return Verdict::Pending;
 }
 
-// Calls Cloud DLP endpoint InspectContent to inspect provided body
-void DlpRootContext::inspectContent(Buffer* buffer) {
-  if (!sampler_->sample()) {
-    not_inspected_->record(1);
-    total_bytes_not_inspected_->record(buffer->appendedSize());
+void DlpRootContext::deliverVerdict(uint32_t context_id, Verdict verdict) {
+  auto held = held_responses_.find(context_id);
+  if (held == held_responses_.end()) {
     return;
   }
+  DlpContext* context = held->second.context;
+  held_responses_.erase(held);
+  context->onVerdict(verdict);
+  // Calls made from here on belong to the root context again.
+  setEffectiveContext();
+}
+
+void DlpRootContext::dropHeldResponse(uint32_t context_id) {
+  held_responses_.erase(context_id);
+}
+
+// Lets the responses whose verdict is late go on as if their call failed,
+// while their calls keep running to report the findings
+void DlpRootContext::expireHeldResponses(uint64_t now_ns) {
+  bool expired = false;
+  for (auto held = held_responses_.begin(); held != held_responses_.end();) {
+    if (held->second.deadline_ns <= now_ns) {
+      DlpContext* context = held->second.context;
+      held = held_responses_.erase(held);
+      context->onVerdict(Verdict::Expired);
+      expired = true;
+    } else {
+      ++held;
+    }
+  }
+  if (expired) {
+    setEffectiveContext();
+  }
+}
+
+std::string_view DlpRootContext::minimize(std::string_view body, const InspectedItem& item) {
+  offsets_.clear();
+  if (!minimizer_) {
+    return body;
+  }
+  stats_->recordSaved(item.traffic_slots, minimizer_->minimize(body, &minimized_, &offsets_));
+  return minimized_;
+}
+
+std::string_view DlpRootContext::minimizeAgain(std::string_view body) {
+  offsets_.clear();
+  if (!minimizer_) {
+    return body;
+  }
+  minimizer_->minimize(body, &minimized_, &offsets_);
+  return minimized_;
+}
 
-  // Prepare request to be sent for inspection
-  InspectContentRequest request = createInspectContentRequest(buffer);
-  std::unique_ptr<GrpcCallHandlerBase> inspect_content_call_handler =
+// Encodes a message for the spool, only when spooling is enabled. Calls keep
+// it until they complete, as the message is gone by the time one fails.
+std::string DlpRootContext::spoolPayload(
+    uint8_t operation, std::string_view body, Direction direction, std::string_view route) {
+  std::string payload;
+  if (spool_) {
+    SpoolMessage{operation, static_cast<uint8_t>(direction), route, body}.appendTo(&payload);
+  }
+  return payload;
+}
+
+// Takes a call from the rate limit, or spools the message it would have
+// carried
+bool DlpRootContext::acquireCall(const InspectedItem& item, std::string_view spool_payload) {
+  if (rate_limiter_->tryAcquire(getCurrentTimeNanoseconds())) {
+    return true;
+  }
+  stats_->add(stats_->throttled, 1);
+  spoolOrDrop(stats_.get(), spool_.get(), item, spool_payload);
+  return false;
+}
+
+bool DlpRootContext::acquireCall(const std::vector<InspectedItem>& items,
+                                 const std::vector<std::string>& spool_payloads) {
+  if (rate_limiter_->tryAcquire(getCurrentTimeNanoseconds())) {
+    return true;
+  }
+  for (size_t i = 0; i < items.size(); i++) {
+    stats_->add(stats_->throttled, 1);
+    spoolOrDrop(stats_.get(), spool_.get(), items[i],
+                spool_payloads.empty() ? std::string_view() : spool_payloads[i]);
+  }
+  return false;
+}
+
+// Records a call the host refused to start. Its handler is dropped without
+// being called. Such failures come from the call configuration, so the
+// messages are not spooled.
+void DlpRootContext::reportCallNotSent(
+    size_t endpoint_index, const std::vector<InspectedItem>& items) {
+  endpoint_picker_->onFailure(endpoint_index, getCurrentTimeNanoseconds());
+  stats_->add(stats_->filter_error, 1);
+  for (const InspectedItem& item : items) {
+    stats_->recordNotInspected(item.traffic_slots, item.size);
+  }
+}
+
+// Calls Cloud DLP endpoint InspectContent to inspect provided body, unless
+// values learned from earlier findings occur in it
+void DlpRootContext::inspectContent(std::string_view body, const OffsetMap& offsets,
+                                    const InspectedItem& item, std::string spool_payload) {
+  if (reportLearnedSecrets(body, offsets, item) || !acquireCall(item, spool_payload)) {
+    return;
+  }
+  const size_t endpoint_index = endpoint_picker_->pick(getCurrentTimeNanoseconds());
+  DlpEndpoint& endpoint = endpoints_[endpoint_index];
+
+  // Prepare request to be sent for inspection. Data is passed along with its
+  // size to correctly handle null bytes in the body.
+  const std::string_view request = endpoint.request_encoder->encode(body.data(), body.size());
+  callInspectContent(
+      endpoint_index,
+      request,
+      std::make_unique<InspectContentCallHandler>(
+          endpoint.parent,
+          local_node_info_,
+          stats_.get(),
+          endpoint_picker_,
+          endpoint_index,
+          std::vector<InspectedItem>{item},
+          offsets,
+          std::vector<InspectedRow>(),
+          learned_secrets_,
+          spool_,
+          singlePayload(std::move(spool_payload))),
+      {item});
+}
+
+// Sends a request and its response as the rows of one table, along with the
+// request URL and headers, so Cloud DLP sees each message with its context.
+// Each message is spooled on its own, and sent alone when resent. A message
+// holding learned values is reported right away and left out of the call.
+void DlpRootContext::inspectCoalesced(const DeferredRequest& request,
+                                      std::string_view response_body,
+                                      const InspectedItem* response_item,
+                                      std::string response_payload) {
+  std::vector<InspectedItem> items;
+  std::vector<InspectedRow> rows;
+  std::vector<std::string> spool_payloads;
+  coalesced_table_->clear();
+
+  // The rows of the request are only added once none holds a learned value.
+  size_t learned_matches = 0;
+  for (const auto& [field, value] : request.fields) {
+    rows.push_back({Direction::Request, field, OffsetMap()});
+    learned_matches += reportLearnedMatches(value, rows.back().offsets, &rows.back());
+  }
+  const std::string_view request_content = request.saved_recorded
+      ? minimizeAgain(request.body)
+      : minimize(request.body, request.item);
+  rows.push_back({Direction::Request, BodyField, offsets_});
+  learned_matches += reportLearnedMatches(request_content, offsets_, &rows.back());
+  if (learned_matches > 0) {
+    recordLearnedMatches(request.item, learned_matches);
+    rows.clear();
+  } else {
+    for (size_t i = 0; i < request.fields.size(); i++) {
+      const auto& [field, value] = request.fields[i];
+      rows[i].located =
+          coalesced_table_->addRow({directionName(Direction::Request), field, value});
+    }
+    rows.back().located =
+        coalesced_table_->addRow({directionName(Direction::Request), BodyField, request_content});
+    items.push_back(request.item);
+    if (spool_) {
+      spool_payloads.push_back(
+          spoolPayload(StoreLocalOperation, request.body, Direction::Request, request.route));
+    }
+  }
+  if (response_item != nullptr) {
+    const std::string_view response_content = minimize(response_body, *response_item);
+    InspectedRow response_row{Direction::Response, BodyField, offsets_};
+    learned_matches = reportLearnedMatches(response_content, offsets_, &response_row);
+    if (learned_matches > 0) {
+      recordLearnedMatches(*response_item, learned_matches);
+    } else {
+      response_row.located = coalesced_table_->addRow(
+          {directionName(Direction::Response), BodyField, response_content});
+      rows.push_back(std::move(response_row));
+      items.push_back(*response_item);
+      if (spool_) {
+        spool_payloads.push_back(std::move(response_payload));
+      }
+    }
+  }
+  if (items.empty() || !acquireCall(items, spool_payloads)) {
+    return;
+  }
+  const size_t endpoint_index = endpoint_picker_->pick(getCurrentTimeNanoseconds());
+  DlpEndpoint& endpoint = endpoints_[endpoint_index];
+  const std::string_view call_request = endpoint.request_encoder->encode(*coalesced_table_);
+  callInspectContent(
+      endpoint_index,
+      call_request,
       std::make_unique<InspectContentCallHandler>(
-          InspectContentCallHandler(
-              parent_,
-              buffer->size(),
-              local_node_info_));
+          endpoint.parent,
+          local_node_info_,
+          stats_.get(),
+          endpoint_picker_,
+          endpoint_index,
+          items,
+          OffsetMap(),
+          std::move(rows),
+          learned_secrets_,
+          spool_,
+          std::move(spool_payloads)),
+      items);
+}
 
+bool DlpRootContext::callInspectContent(size_t endpoint_index, std::string_view request,
+                                        std::unique_ptr<GrpcCallHandlerBase> handler,
+                                        const std::vector<InspectedItem>& items) {
+  const DlpEndpoint& endpoint = endpoints_[endpoint_index];
   HeaderStringPairs initial_metadata;
-  initial_metadata.push_back(std::pair("parent", parent_));
+  initial_metadata.push_back(std::pair("parent", endpoint.parent));
 
   // Send grpc request
-  grpcCallHandler(
-      grpc_service_string_,
+  const WasmResult result = grpcCallHandler(
+      endpoint.grpc_service,
       DlpServiceName,
       InspectContentMethodName,
       initial_metadata,
       request,
       Timeout10s,
-      std::move(inspect_content_call_handler));
+      std::move(handler));
+  if (result != WasmResult::Ok) {
+    reportCallNotSent(endpoint_index, items);
+    return false;
+  }
+  return true;
+}
+
+// Reports the values learned from earlier findings that occur in body, if
+// any, in place of calling Cloud DLP
+bool DlpRootContext::reportLearnedSecrets(
+    std::string_view body, const OffsetMap& offsets, const InspectedItem& item) {
+  const size_t matches = reportLearnedMatches(body, offsets, nullptr);
+  if (matches == 0) {
+    return false;
+  }
+  recordLearnedMatches(item, matches);
+  return true;
+}
+
+// Records a message reported from learned values as inspected
+void DlpRootContext::recordLearnedMatches(const InspectedItem& item, size_t matches) {
+  stats_->add(stats_->findings, matches);
+  stats_->add(stats_->learned_matches, 1);
+  stats_->recordInspected(item.traffic_slots, item.size);
+}
+
+// row is the row of a coalesced stream body is the value of, if any
+size_t DlpRootContext::reportLearnedMatches(
+    std::string_view body, const OffsetMap& offsets, const InspectedRow* row) {
+  if (!learned_secrets_) {
+    return 0;
+  }
+  learned_matches_.clear();
+  learned_secrets_->find(body, getCurrentTimeNanoseconds(), &learned_matches_);
+  for (const LearnedSecrets::Match& match : learned_matches_) {
+    stats_->add(stats_->findingsByInfoType(match.info_type), 1);
+    std::string log_line = findingLogLine(local_node_info_.get(), match.info_type);
+    appendRange(&log_line, offsets.original(match.start), offsets.originalEnd(match.end));
+    if (row != nullptr) {
+      appendRow(&log_line, *row);
+    }
+    logWarn(log_line);
+  }
+  return learned_matches_.size();
+}
+
+// Adds a message as a row of the hybrid inspect batch. The batch is sent
+// when it has max_batch_size rows, before it would exceed the maximum
+// request size, or on the first tick after max_batch_delay_ms.
+void DlpRootContext::addToHybridBatch(std::string_view body, Direction direction,
+                                      std::string_view route, const InspectedItem& item,
+                                      std::string spool_payload) {
+  const size_t row_size = body.size() + route.size() + HybridRowOverhead;
+  if (!hybrid_batch_items_.empty() && hybrid_batch_->size() + row_size > getMaxRequestSize()) {
+    flushHybridBatch();
+  }
+  if (hybrid_batch_items_.empty()) {
+    hybrid_batch_start_ns_ = getCurrentTimeNanoseconds();
+  }
+  hybrid_batch_->addRow({
+      route.empty() ? std::string_view(NoRoute) : route,
+      directionName(direction),
+      body});
+  hybrid_batch_items_.push_back(item);
+  if (!spool_payload.empty()) {
+    hybrid_batch_payloads_.push_back(std::move(spool_payload));
+  }
+
+  const uint32_t max_batch_size =
+      config_.inspect().destination().operation().hybrid_inspect().max_batch_size();
+  if (hybrid_batch_->rowCount() >= (max_batch_size > 0 ? max_batch_size : DefaultMaxBatchSize)) {
+    flushHybridBatch();
+  }
 }
 
-InspectContentRequest DlpRootContext::createInspectContentRequest(Buffer* buffer) const {
-  InspectContentRequest request;
-  // Passing data along with its size to correctly handle null bytes in the array
-  request.mutable_item()->mutable_byte_item()->set_data(buffer->data(), buffer->size());
-  request.set_parent(parent_);
-  if (!config_.inspect().destination().operation().store_local().inspect_template_name().empty()) {
-    request.set_inspect_template_name(
-        config_.inspect().destination().operation().store_local().inspect_template_name());
+// Sends the hybrid inspect batch to the job trigger. Only the
+// acknowledgement is awaited: findings are stored by Cloud DLP.
+void DlpRootContext::flushHybridBatch() {
+  if (hybrid_batch_items_.empty()) {
+    return;
+  }
+  std::vector<InspectedItem> items;
+  std::vector<std::string> spool_payloads;
+  items.swap(hybrid_batch_items_);
+  spool_payloads.swap(hybrid_batch_payloads_);
+  if (!acquireCall(items, spool_payloads)) {
+    hybrid_batch_->clear();
+    return;
   }
-  if (!config_.inspect().destination().operation().store_local().location_id().empty()) {
-    request.set_location_id(
-        config_.inspect().destination().operation().store_local().location_id());
+  const size_t endpoint_index = endpoint_picker_->pick(getCurrentTimeNanoseconds());
+  const DlpEndpoint& endpoint = endpoints_[endpoint_index];
+  const std::string& job_trigger_name =
+      config_.inspect().destination().operation().hybrid_inspect().job_trigger_name();
+
+  const std::string_view request = hybrid_request_encoder_->encode(*hybrid_batch_);
+  hybrid_batch_->clear();
+  std::unique_ptr<GrpcCallHandlerBase> hybrid_inspect_call_handler =
+      std::make_unique<DlpCallHandler>(
+          HybridInspectMethodName,
+          job_trigger_name,
+          stats_.get(),
+          endpoint_picker_,
+          endpoint_index,
+          items,
+          spool_,
+          std::move(spool_payloads));
+
+  HeaderStringPairs initial_metadata;
+  initial_metadata.push_back(std::pair(XGoogRequestParams, "name=" + job_trigger_name));
+
+  const WasmResult result = grpcCallHandler(
+      endpoint.grpc_service,
+      DlpServiceName,
+      HybridInspectMethodName,
+      initial_metadata,
+      request,
+      Timeout10s,
+      std::move(hybrid_inspect_call_handler));
+  if (result != WasmResult::Ok) {
+    reportCallNotSent(endpoint_index, items);
+  }
+}
+
+// Sends spooled messages again at the drain rate, unless every endpoint is
+// ejected, and reports the spool depth
+void DlpRootContext::drainSpool() {
+  const uint64_t now_ns = getCurrentTimeNanoseconds();
+  if (endpoint_picker_->hasAvailable(now_ns)) {
+    spool_->drain(now_ns, &spool_entries_, &spool_expired_);
+    for (const Spool::Entry& entry : spool_expired_) {
+      SpoolMessage message;
+      if (SpoolMessage::parse(entry.payload, &message)) {
+        stats_->add(stats_->spool_expired, 1);
+        stats_->recordNotInspected(
+            stats_->traffic(message.route, static_cast<Direction>(message.direction)),
+            message.body.size());
+      }
+    }
+    const ::dlp::DestinationOperation& operation = config_.inspect().destination().operation();
+    for (const Spool::Entry& entry : spool_entries_) {
+      SpoolMessage message;
+      if (!SpoolMessage::parse(entry.payload, &message)) {
+        stats_->add(stats_->filter_error, 1);
+        continue;
+      }
+      const Direction direction = static_cast<Direction>(message.direction);
+      const InspectedItem item{
+          stats_->traffic(message.route, direction), message.body.size(), entry.spooled_ns};
+      stats_->add(stats_->spool_resent, 1);
+      // The bytes minimization saves were recorded when the message was
+      // captured.
+      if (message.operations == StoreLocalOperation && operation.has_store_local()) {
+        inspectContent(minimizeAgain(message.body), offsets_, item, entry.payload);
+      } else if (message.operations == HybridInspectOperation && hybrid_batch_) {
+        addToHybridBatch(
+            minimizeAgain(message.body), direction, message.route, item, entry.payload);
+      } else {
+        // The operation is no longer configured.
+        stats_->recordNotInspected(item.traffic_slots, item.size);
+      }
+    }
   }
-  size_t inspected_body_size = buffer->size();
-  return request;
+  stats_->recordSpoolDepth(spool_->depth(now_ns));
 }
 
 size_t DlpRootContext::getMaxRequestSize() {
@@ -326,43 +1487,253 @@ size_t DlpRootContext::getMaxRequestSize() {
 // Context created per stream
 
 
+// Matches the request against the capture rules and keeps the request
+// properties the response is matched by
+FilterHeadersStatus DlpContext::onRequestHeaders(uint32_t, bool end_of_stream) {
+  if (!end_of_stream && rootContext()->coalescing()) {
+    collectRequestFields();
+  }
+  if (rootContext()->captureRules().empty()) {
+    return FilterHeadersStatus::Continue;
+  }
+  method_ = getRequestHeader(":method")->toString();
+  path_ = getRequestHeader(":path")->toString();
+  path_.resize(std::min(path_.size(), path_.find('?')));
+  host_ = getRequestHeader(":authority")->toString();
+  if (!end_of_stream) {
+    const WasmDataPtr content_type = getRequestHeader("content-type");
+    const WasmDataPtr content_length = getRequestHeader("content-length");
+    matchCaptureRules(&request_, {
+        false, method_, path_, host_, content_type->view(), 0,
+        parseHeaderNumber(content_length->view())});
+  }
+  return FilterHeadersStatus::Continue;
+}
+
+// Holds the headers of an enforced response along with its body, so that the
+// response can still be replaced once inspected
+FilterHeadersStatus DlpContext::onResponseHeaders(uint32_t, bool end_of_stream) {
+  if (end_of_stream) {
+    return FilterHeadersStatus::Continue;
+  }
+  DlpRootContext* root = rootContext();
+  if (!root->captureRules().empty()) {
+    const WasmDataPtr status = getResponseHeader(":status");
+    const WasmDataPtr content_type = getResponseHeader("content-type");
+    const WasmDataPtr content_length = getResponseHeader("content-length");
+    const uint64_t status_code = parseHeaderNumber(status->view());
+    matchCaptureRules(&response_, {
+        true, method_, path_, host_, content_type->view(),
+        status_code <= UINT32_MAX ? static_cast<uint32_t>(status_code) : 0,
+        parseHeaderNumber(content_length->view())});
+  }
+  if (response_.match.capture && root->enforced(routeName())) {
+    enforced_ = true;
+    return FilterHeadersStatus::StopIteration;
+  }
+  return FilterHeadersStatus::Continue;
+}
+
+// Reads the URL and request headers sent along with the request body
+void DlpContext::collectRequestFields() {
+  request_fields_.emplace_back(
+      UrlField, getRequestHeader(":authority")->toString() + getRequestHeader(":path")->toString());
+  for (const std::string& name : rootContext()->coalescedHeaders()) {
+    const WasmDataPtr value = getRequestHeader(name);
+    if (value->size() > 0) {
+      request_fields_.emplace_back(HeaderFieldPrefix + name, value->toString());
+    }
+  }
+}
+
+void DlpContext::matchCaptureRules(Capture* capture, const MessageProperties& message) {
+  DlpRootContext* root = rootContext();
+  capture->match = root->captureRules().match(message);
+  if (capture->match.needs_body_size) {
+    capture->content_type = message.content_type;
+    capture->status = message.status;
+  } else if (const DlpStats::CaptureRuleSlots* slots = root->captureRuleSlots(capture->match.rule)) {
+    root->stats().add(slots->matched, 1);
+  }
+}
+
 // Captures request body and passes it for inspection at DlpRootContext level
 FilterDataStatus DlpContext::onRequestBody(size_t body_buffer_length, bool end_of_stream) {
-  WasmDataPtr buffer = getBufferBytes(WasmBufferType::HttpRequestBody, 0, body_buffer_length);
-  request_buffer_->append(buffer->data(), buffer->size());
-  maybeInspect(request_buffer_.get(), end_of_stream);
+  if (captureBody(WasmBufferType::HttpRequestBody, &request_, Direction::Request, 0,
+                  body_buffer_length, end_of_stream)) {
+    inspect(request_.buffer.get(), Direction::Request);
+  }
   return FilterDataStatus::Continue;
 }
 
-// Captures response body and passes it for inspection at DlpRootContext level
+// Captures response body and passes it for inspection at DlpRootContext level.
+// An enforced response is held until its verdict. The host buffers the held
+// body, so every call sees all of it, of which only the new bytes are read.
 FilterDataStatus DlpContext::onResponseBody(size_t body_buffer_length, bool end_of_stream) {
-  WasmDataPtr buffer = getBufferBytes(WasmBufferType::HttpResponseBody, 0, body_buffer_length);
-  response_buffer_->append(buffer->data(), buffer->size());
-  maybeInspect(response_buffer_.get(), end_of_stream);
-  return FilterDataStatus::Continue;
+  if (!enforced_) {
+    if (captureBody(WasmBufferType::HttpResponseBody, &response_, Direction::Response, 0,
+                    body_buffer_length, end_of_stream)) {
+      inspect(response_.buffer.get(), Direction::Response);
+    }
+    return FilterDataStatus::Continue;
+  }
+  const size_t offset = response_.buffer ? response_.buffer->appendedSize() : 0;
+  captureBody(WasmBufferType::HttpResponseBody, &response_, Direction::Response, offset,
+              body_buffer_length, end_of_stream);
+  if (!end_of_stream) {
+    return FilterDataStatus::StopIterationAndBuffer;
+  }
+  const Verdict verdict = enforceResponse();
+  if (verdict == Verdict::Pending) {
+    return FilterDataStatus::StopIterationAndBuffer;
+  }
+  return applyVerdict(verdict) ? FilterDataStatus::StopIterationNoBuffer
+                               : FilterDataStatus::Continue;
 }
 
-void DlpContext::maybeInspect(Buffer* buffer, bool end_of_stream) {
-  if (end_of_stream) {
-    if (buffer->isEmpty()) {
-      // Nothing to inspect
-    } else if (buffer->isExceeded()) {
-      reportExceeded(buffer->appendedSize());
-    } else {
-      rootContext()->inspect(buffer);
+// Responses with trailers end with them rather than with the last body chunk
+FilterTrailersStatus DlpContext::onResponseTrailers(uint32_t) {
+  if (!enforced_) {
+    return FilterTrailersStatus::Continue;
+  }
+  if (response_.buffer && response_.match.needs_body_size) {
+    matchCaptureRules(&response_, {
+        true, method_, path_, host_, response_.content_type, response_.status,
+        response_.buffer->appendedSize()});
+    if (!response_.match.capture) {
+      reportSkipped(response_, response_.buffer->appendedSize());
+    }
+  }
+  const Verdict verdict = enforceResponse();
+  if (verdict == Verdict::Pending || applyVerdict(verdict)) {
+    return FilterTrailersStatus::StopIteration;
+  }
+  return FilterTrailersStatus::Continue;
+}
+
+// Appends a body chunk to the capture buffer, unless the message is skipped,
+// in which case the chunk is not even read
+bool DlpContext::captureBody(WasmBufferType type, Capture* capture, Direction direction,
+                             size_t offset, size_t body_buffer_length, bool end_of_stream) {
+  if (!capture->match.capture) {
+    reportSkipped(*capture, body_buffer_length - offset);
+    return false;
+  }
+  if (!capture->buffer) {
+    capture->buffer = std::make_unique<Buffer>(rootContext()->getMaxRequestSize());
+  }
+  WasmDataPtr buffer = getBufferBytes(type, offset, body_buffer_length - offset);
+  capture->buffer->append(buffer->data(), buffer->size());
+  if (!end_of_stream) {
+    return false;
+  }
+  if (capture->match.needs_body_size) {
+    matchCaptureRules(capture, {
+        direction == Direction::Response, method_, path_, host_, capture->content_type,
+        capture->status, capture->buffer->appendedSize()});
+    if (!capture->match.capture) {
+      reportSkipped(*capture, capture->buffer->appendedSize());
+      return false;
     }
   }
+  return true;
+}
+
+void DlpContext::inspect(Buffer* buffer, Direction direction) {
+  if (buffer->isEmpty()) {
+    // Nothing to inspect
+  } else if (buffer->isExceeded()) {
+    reportExceeded(buffer->appendedSize(), direction);
+  } else if (direction == Direction::Request && rootContext()->coalescing()) {
+    rootContext()->deferRequest(id(), std::string_view(buffer->data(), buffer->size()),
+                                routeName(), std::move(request_fields_));
+  } else {
+    rootContext()->inspect(
+        std::string_view(buffer->data(), buffer->size()), direction, routeName(), id());
+  }
+}
+
+// Inspects the held response once fully received. Responses that cannot be
+// inspected fail right away.
+Verdict DlpContext::enforceResponse() {
+  enforced_ = false;
+  held_ns_ = getCurrentTimeNanoseconds();
+  Buffer* buffer = response_.buffer.get();
+  if (!response_.match.capture || buffer == nullptr || buffer->isEmpty()) {
+    return Verdict::Skipped;
+  }
+  Verdict verdict;
+  if (buffer->isExceeded()) {
+    reportExceeded(buffer->appendedSize(), Direction::Response);
+    verdict = Verdict::Failed;
+  } else {
+    verdict = rootContext()->enforce(
+        std::string_view(buffer->data(), buffer->size()), routeName(), this);
+  }
+  return verdict;
+}
+
+// Replaces the held response by the local response when it holds findings,
+// or could not be inspected when failing closed. Returns whether it was
+// replaced.
+bool DlpContext::applyVerdict(Verdict verdict) {
+  if (verdict == Verdict::Skipped) {
+    return false;
+  }
+  DlpRootContext* root = rootContext();
+  DlpStats& stats = root->stats();
+  stats.recordEnforceLatency(getCurrentTimeNanoseconds() - held_ns_);
+  if (verdict == Verdict::Expired) {
+    stats.add(stats.enforce_deadline_expired, 1);
+  }
+  const ::dlp::EnforceConfig& config = root->enforceConfig();
+  if (verdict == Verdict::Clean || (verdict != Verdict::Findings && !config.fail_closed())) {
+    return false;
+  }
+  stats.add(stats.enforce_blocked, 1);
+  sendLocalResponse(config.status_code() > 0 ? config.status_code() : DefaultEnforceStatusCode,
+                    EnforceResponseDetails, config.body(), {});
+  return true;
+}
+
+void DlpContext::onVerdict(Verdict verdict) {
+  setEffectiveContext();
+  if (!applyVerdict(verdict)) {
+    continueResponse();
+  }
+}
+
+// Inspects the request alone if the stream ends before its response is
+// captured, and stops waiting for the verdict on its response
+bool DlpContext::onDone() {
+  rootContext()->releaseRequest(id());
+  rootContext()->dropHeldResponse(id());
+  return true;
+}
+
+void DlpContext::reportSkipped(const Capture& capture, size_t size) {
+  DlpRootContext* root = rootContext();
+  if (const DlpStats::CaptureRuleSlots* slots = root->captureRuleSlots(capture.match.rule)) {
+    root->stats().add(slots->bytes_skipped, size);
+  }
+}
+
+void DlpContext::reportExceeded(size_t buffer_size, Direction direction) {
+  DlpStats& stats = rootContext()->stats();
+  stats.add(stats.request_too_large, 1);
+  stats.recordNotInspected(stats.traffic(routeName(), direction), buffer_size);
 }
 
-void DlpContext::reportExceeded(size_t buffer_size) {
-  request_too_large_->record(1);
-  not_inspected_->record(1);
-  total_bytes_not_inspected_->record(buffer_size);
+// Name of the route the stream was matched to, empty if none
+std::string DlpContext::routeName() {
+  std::string route;
+  getValue({"route_name"}, &route);
+  return route;
 }
 
 #ifdef NULL_PLUGIN
 
-}  // namespace basic_auth
+}  // namespace dlp
 }  // namespace null_plugin
 }  // namespace proxy_wasm
 
@@ -12,30 +12,59 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <charconv>
 #include <string>
 #include <unordered_set>
 #define ASSERT(_X) assert(_X)
 
-#include "plugin/config.pb.h"
 #include "buffer/buffer.h"
+#include "capture/capture_rules.h"
+#include "endpoint/endpoint_picker.h"
+#include "learned/learned_secrets.h"
+#include "minimize/minimizer.h"
+#include "ratelimit/token_bucket.h"
 #include "sampling/sampling.h"
-#include "google/privacy/dlp/v2/dlp.pb.h"
+#include "spool/spool.h"
+#include "stats/accumulator.h"
+#include "stats/tagged_metric.h"
+#include "wire/decoder.h"
+#include "wire/encoder.h"
+#ifdef PROXY_WASM_PROTOBUF_LITE
+#include "plugin/config_lite.pb.h"
+#include "config/config_parser.h"
+#include "google/protobuf/stubs/status.h"
+#else
+#include "plugin/config.pb.h"
 #include "google/protobuf/util/json_util.h"
+#endif
 
 static constexpr char Separator[] = ":";
 static constexpr char VersionKey[] = "version";
 
 using google::protobuf::util::Status;
-using google::protobuf::util::JsonParseOptions;
 using google::protobuf::util::error::Code;
-using google::privacy::dlp::v2::ContentItem;
-using google::privacy::dlp::v2::InspectContentRequest;
-using google::privacy::dlp::v2::InspectContentResponse;
-using google::privacy::dlp::v2::Container;
 using google::dlp_filter::Buffer;
+using google::dlp_filter::CaptureRules;
+using google::dlp_filter::EndpointPicker;
+using google::dlp_filter::FindingView;
+using google::dlp_filter::HybridInspectRequestEncoder;
+using google::dlp_filter::InspectContentRequestEncoder;
+using google::dlp_filter::InspectContentResponseScanner;
+using google::dlp_filter::LearnedSecrets;
+using google::dlp_filter::MessageProperties;
+using google::dlp_filter::Minimizer;
+using google::dlp_filter::OffsetMap;
 using google::dlp_filter::Sampler;
 using google::dlp_filter::PassthroughSampler;
 using google::dlp_filter::ProbabilisticSampler;
+using google::dlp_filter::SharedStore;
+using google::dlp_filter::Spool;
+using google::dlp_filter::SpoolMessage;
+using google::dlp_filter::StatAccumulator;
+using google::dlp_filter::TableEncoder;
+using google::dlp_filter::TaggedMetric;
+using google::dlp_filter::TagValues;
+using google::dlp_filter::TokenBucket;
 
 #ifndef NULL_PLUGIN
 
@@ -98,6 +127,10 @@ class NodeInfoContainerDetails {
     return labels_;
   }
 
+  const std::string& workloadName() {
+    return workload_name_;
+  }
+
  private:
   const std::string mesh_id_;
   const std::string namespace_;
@@ -106,50 +139,404 @@ class NodeInfoContainerDetails {
   const std::map<std::string, std::string> labels_;
 };
 
+// Direction of the captured traffic
+enum class Direction {
+  Request = 0,
+  Response = 1,
+};
+
+// Outcome of the inspection of an enforced response
+enum class Verdict {
+  // The inspection call is in flight
+  Pending,
+  // Not inspected, as decided by its capture rule
+  Skipped,
+  Clean,
+  Findings,
+  // Not inspected: throttled, too large or failed call
+  Failed,
+  // The inspection did not complete before the deadline
+  Expired,
+};
+
+// Metrics reported by the filter.
+//
+// Counters are recorded through slots of a StatAccumulator, so recording is an
+// addition inside the VM and reaching the host is left to the root context's
+// flushes. Traffic counters are additionally reported tagged with route,
+// direction and workload, and findings with info type; each tag reports at
+// most max_tag_values distinct values.
+//
+// Owned by the root context rather than being global: in NULL_PLUGIN builds
+// every worker's VM runs in the same process and must not share them.
+class DlpStats {
+ public:
+  // Slots of the tagged traffic counters of one route and direction
+  struct TrafficSlots {
+    uint32_t inspected;
+    uint32_t bytes_inspected;
+    uint32_t not_inspected;
+    uint32_t bytes_not_inspected;
+    uint32_t bytes_saved;
+  };
+
+  // Slots of the counters of one capture rule
+  struct CaptureRuleSlots {
+    // Messages the rule decided on
+    uint32_t matched;
+    // Body bytes of the messages it skipped
+    uint32_t bytes_skipped;
+  };
+
+  DlpStats(StatAccumulator* accumulator, size_t max_tag_values, std::string_view workload);
+
+  void add(uint32_t slot, uint64_t value) {
+    accumulator_->add(slot, value);
+  }
+
+  // Records a message of the given size as (not) inspected, in total and for
+  // its route and direction.
+  void recordInspected(const TrafficSlots& traffic_slots, size_t size);
+  void recordNotInspected(const TrafficSlots& traffic_slots, size_t size);
+  // Records bytes dropped from a message by minimization before it was sent.
+  void recordSaved(const TrafficSlots& traffic_slots, size_t size);
+  // Reports the spool gauges, which are recorded directly rather than
+  // accumulated
+  void recordSpoolDepth(const Spool::Depth& depth);
+  // Records the time an enforced response was held once fully received
+  void recordEnforceLatency(uint64_t latency_ns);
+
+  TrafficSlots traffic(std::string_view route, Direction direction);
+  uint32_t findingsByInfoType(std::string_view info_type);
+  CaptureRuleSlots captureRule(std::string_view name);
+  // Number of times particular grpc_status was returned
+  uint32_t grpcStatus(GrpcStatus status);
+
+  // Number of messages sent for inspection
+  const uint32_t inspected;
+  // Number of messages not inspected (should be 0 if sampling is 100%)
+  const uint32_t not_inspected;
+  // Sum of all bytes sent for inspection (might differ from actually inspected
+  // bytes in case there was an issue on Cloud DLP side)
+  const uint32_t total_bytes_inspected;
+  // Sum of all bytes that could have been sent for inspection but weren't
+  // due to sampling or rpc-related issues.
+  const uint32_t total_bytes_not_inspected;
+  // Sum of all bytes dropped by minimization from messages sent for
+  // inspection
+  const uint32_t total_bytes_saved;
+  // When request sent to the server is too large
+  const uint32_t request_too_large;
+  // Any other error
+  const uint32_t filter_error;
+  // Number of times grpc returned an error (grpc_status was different than 0)
+  const uint32_t grpc_error;
+  // Number of findings returned found by DLP
+  const uint32_t findings;
+  // Number of times an endpoint was taken out of use after consecutive
+  // failures
+  const uint32_t endpoint_ejected;
+  // Number of messages not sent right away because of the rate limit
+  const uint32_t throttled;
+  // Number of messages reported from values learned from earlier findings,
+  // without calling Cloud DLP
+  const uint32_t learned_matches;
+  // Number of streams whose request and response were sent in a single call
+  const uint32_t coalesced;
+  // Number of enforced responses replaced by a local response, and whose
+  // inspection did not complete before the deadline
+  const uint32_t enforce_blocked;
+  const uint32_t enforce_deadline_expired;
+  // Number of messages put in the spool, and not put there because it was
+  // full
+  const uint32_t spooled;
+  const uint32_t spool_dropped;
+  // Number of spooled messages sent again, and dropped for their age
+  const uint32_t spool_resent;
+  const uint32_t spool_expired;
+
+ private:
+  StatAccumulator* accumulator_;
+  std::unordered_map<int, uint32_t> grpc_status_slots_;
+  // Gauge metric ids of the spool depth
+  uint32_t spool_entries_;
+  uint32_t spool_bytes_;
+  uint32_t spool_oldest_age_ms_;
+  // Histogram metric id of the time enforced responses were held
+  uint32_t enforce_latency_ms_;
+  TagValues route_;
+  TagValues direction_;
+  TagValues workload_;
+  TagValues info_type_;
+  TagValues capture_rule_;
+  uint16_t direction_indices_[2];
+  uint16_t workload_index_;
+  TaggedMetric tagged_inspected_;
+  TaggedMetric tagged_bytes_inspected_;
+  TaggedMetric tagged_not_inspected_;
+  TaggedMetric tagged_bytes_not_inspected_;
+  TaggedMetric tagged_bytes_saved_;
+  TaggedMetric tagged_findings_;
+  TaggedMetric tagged_capture_rule_matched_;
+  TaggedMetric tagged_capture_rule_bytes_skipped_;
+};
+
+// Captured message sent in a call to Cloud DLP
+struct InspectedItem {
+  DlpStats::TrafficSlots traffic_slots;
+  size_t size;
+  // When the message was captured, kept while it is spooled
+  uint64_t captured_ns;
+};
+
+// Row of the table sent for a coalesced stream
+struct InspectedRow {
+  Direction direction;
+  // "url", "header.<name>" or "body"
+  std::string field;
+  // Maps the value back to the captured value, before minimization
+  OffsetMap offsets;
+  // Whether offsets in the value are those of the minimized value, false
+  // once invalid UTF-8 was replaced in it
+  bool located = true;
+};
+
+// Request field sent along with a coalesced stream, by field name
+using RequestField = std::pair<std::string, std::string>;
+
+// Cloud DLP endpoint calls can be sent to
+struct DlpEndpoint {
+  // DLP Destination grpc config
+  std::string grpc_service;
+  // InspectContent parent name consisting of projects/<project_id>/locations/<location_id>
+  std::string parent;
+  // Serializes InspectContent requests, holds the fields constant for every
+  // call. Only set when findings are stored locally.
+  std::unique_ptr<InspectContentRequestEncoder> request_encoder;
+};
+
+class DlpContext;
+
 class DlpRootContext : public RootContext {
  public:
   explicit DlpRootContext(uint32_t id, std::string_view root_id) : RootContext(id, root_id) {}
   bool onConfigure(size_t) override;
+  void onTick() override;
+  bool onDone() override;
   size_t getMaxRequestSize();
-  void inspect(Buffer* buffer);
+  // Inspects a message captured by the stream context_id
+  void inspect(std::string_view body, Direction direction, std::string_view route,
+               uint32_t context_id);
+  // Whether requests wait for their response to be inspected along with it
+  bool coalescing() const {
+    return coalesced_table_ != nullptr;
+  }
+  // Holds a captured request until the response of the stream is inspected,
+  // when coalescing
+  void deferRequest(uint32_t context_id, std::string_view body, std::string_view route,
+                    std::vector<RequestField> fields);
+  // Inspects the request held for the stream alone, if any
+  void releaseRequest(uint32_t context_id);
+  // Whether the responses of the route are held until inspected
+  bool enforced(const std::string& route) const {
+    return enforced_routes_.count(route) > 0;
+  }
+  const ::dlp::EnforceConfig& enforceConfig() const {
+    return config_.inspect().enforce();
+  }
+  // Inspects a response held by the stream. Unless the verdict is known right
+  // away, it is delivered to the stream when the call completes, or as
+  // Verdict::Expired once the deadline passed.
+  Verdict enforce(std::string_view body, std::string_view route, DlpContext* context);
+  // Delivers the verdict on the response held by the stream context_id,
+  // unless it expired or the stream is gone
+  void deliverVerdict(uint32_t context_id, Verdict verdict);
+  // Forgets the response held by the stream context_id, once the stream is
+  // gone
+  void dropHeldResponse(uint32_t context_id);
+  // Names of the request headers sent along with coalesced requests
+  const google::protobuf::RepeatedPtrField<std::string>& coalescedHeaders() const {
+    return config_.inspect().coalesce().request_headers();
+  }
+  DlpStats& stats() {
+    return *stats_;
+  }
+  const CaptureRules& captureRules() {
+    return capture_rules_;
+  }
+  // Counters of a rule returned by captureRules(), null for NoRule
+  const DlpStats::CaptureRuleSlots* captureRuleSlots(size_t rule) {
+    return rule < capture_rule_slots_.size() ? &capture_rule_slots_[rule] : nullptr;
+  }
 
  private:
   Status createSampler();
   Status extractPartialLocalNodeInfo(
     std::shared_ptr<NodeInfoContainerDetails>& details);
-  std::string getFormattedLabel(const std::string& label);
-  void inspectContent(Buffer* buffer);
-  InspectContentRequest createInspectContentRequest(Buffer* buffer) const;
+  bool createEndpoints();
+  void createStats();
+  void createHybridInspect();
+  bool createCaptureRules();
+  void createSpool();
+  void createMinimizer();
+  void createLearnedSecrets();
+  // Request waiting for the response of its stream
+  struct DeferredRequest {
+    InspectedItem item;
+    std::string route;
+    std::string body;
+    std::vector<RequestField> fields;
+    uint64_t deadline_ns;
+    // Whether the bytes minimization saves were recorded when deferred
+    bool saved_recorded;
+  };
+
+  // Response waiting for its verdict
+  struct HeldResponse {
+    DlpContext* context;
+    uint64_t deadline_ns;
+  };
+
+  void createCoalescing();
+  void createEnforcement();
+  void releaseRequests(uint64_t now_ns);
+  void expireHeldResponses(uint64_t now_ns);
+  // Logs the learned values occurring in body and returns how many
+  size_t reportLearnedMatches(
+      std::string_view body, const OffsetMap& offsets, const InspectedRow* row);
+  bool reportLearnedSecrets(
+      std::string_view body, const OffsetMap& offsets, const InspectedItem& item);
+  void recordLearnedMatches(const InspectedItem& item, size_t matches);
+  // Minimizes a message about to be sent, into minimized_ and offsets_,
+  // unless minimization is disabled. Returns the content to send.
+  std::string_view minimize(std::string_view body, const InspectedItem& item);
+  // Same for a message whose saved bytes were recorded when first minimized
+  std::string_view minimizeAgain(std::string_view body);
+  std::string spoolPayload(
+      uint8_t operation, std::string_view body, Direction direction, std::string_view route);
+  // offsets map body back to the captured message. body may point into
+  // spool_payload, which is only moved after the body was used.
+  void inspectContent(std::string_view body, const OffsetMap& offsets, const InspectedItem& item,
+                      std::string spool_payload);
+  void addToHybridBatch(std::string_view body, Direction direction, std::string_view route,
+                        const InspectedItem& item, std::string spool_payload);
+  // Sends a request and its response, null if the response is not inspected,
+  // in a single call
+  void inspectCoalesced(const DeferredRequest& request, std::string_view response_body,
+                        const InspectedItem* response_item, std::string response_payload);
+  // Returns whether the call started
+  bool callInspectContent(size_t endpoint_index, std::string_view request,
+                          std::unique_ptr<GrpcCallHandlerBase> handler,
+                          const std::vector<InspectedItem>& items);
+  void flushHybridBatch();
+  bool acquireCall(const InspectedItem& item, std::string_view spool_payload);
+  bool acquireCall(const std::vector<InspectedItem>& items,
+                   const std::vector<std::string>& spool_payloads);
+  void reportCallNotSent(size_t endpoint_index, const std::vector<InspectedItem>& items);
+  void drainSpool();
 
   // Parsed filter config
   ::dlp::PluginConfig config_;
-  // InspectContent parent name consisting of parent/<project_id>/locations/<location_id>
-  std::string parent_;
-  // DLP Destination grpc config
-  std::string grpc_service_string_;
+  // Endpoints calls are spread over, and the picker choosing among them
+  std::vector<DlpEndpoint> endpoints_;
+  std::shared_ptr<EndpointPicker> endpoint_picker_;
+  // Rules choosing the captured messages, and their counters by rule index
+  CaptureRules capture_rules_;
+  std::vector<DlpStats::CaptureRuleSlots> capture_rule_slots_;
+  // Limits calls to Cloud DLP of all operations
+  std::unique_ptr<TokenBucket> rate_limiter_;
+  // Hybrid inspect request encoder and the batch of messages waiting to be
+  // sent, unset unless the operation is configured
+  std::unique_ptr<HybridInspectRequestEncoder> hybrid_request_encoder_;
+  std::unique_ptr<TableEncoder> hybrid_batch_;
+  std::vector<InspectedItem> hybrid_batch_items_;
+  std::vector<std::string> hybrid_batch_payloads_;
+  uint64_t hybrid_batch_start_ns_ = 0;
+  // Messages to send again later, unset unless enabled. Shared with the
+  // calls that may spool their messages.
+  std::shared_ptr<Spool> spool_;
+  std::vector<Spool::Entry> spool_entries_;
+  std::vector<Spool::Entry> spool_expired_;
+  // Shrinks messages before they are sent, unset unless enabled, and the last
+  // minimized message
+  std::unique_ptr<Minimizer> minimizer_;
+  std::string minimized_;
+  OffsetMap offsets_;
+  // Values reported in earlier findings, unset unless enabled. Shared with
+  // the calls that learn them.
+  std::shared_ptr<LearnedSecrets> learned_secrets_;
+  std::vector<LearnedSecrets::Match> learned_matches_;
+  // Requests waiting for their response by context id, and the table they are
+  // sent in, unset unless coalescing
+  std::unordered_map<uint32_t, DeferredRequest> deferred_requests_;
+  std::unique_ptr<TableEncoder> coalesced_table_;
+  // Routes whose responses are held until inspected, empty unless enforcing,
+  // and the responses waiting for their verdict by context id
+  std::unordered_set<std::string> enforced_routes_;
+  std::unordered_map<uint32_t, HeldResponse> held_responses_;
   // NodeInfo from metadata_exchange filter
   std::shared_ptr<NodeInfoContainerDetails> local_node_info_;
   // Sampling strategy, based on configuration
   std::unique_ptr<Sampler> sampler_;
+  // Sums up counters between flushes to the host, done last at
+  // last_stats_flush_ns
+  std::unique_ptr<StatAccumulator> stat_accumulator_;
+  std::unique_ptr<DlpStats> stats_;
+  uint64_t last_stats_flush_ns_ = 0;
 };
 
 // Per-stream context.
 class DlpContext : public Context {
  public:
-  explicit DlpContext(uint32_t id, RootContext* root)
-    : Context(id, root),
-      request_buffer_(std::make_unique<Buffer>(dynamic_cast<DlpRootContext*>(root)->getMaxRequestSize())),
-      response_buffer_(std::make_unique<Buffer>(dynamic_cast<DlpRootContext*>(root)->getMaxRequestSize()))
-      {}
+  explicit DlpContext(uint32_t id, RootContext* root) : Context(id, root) {}
+      FilterHeadersStatus onRequestHeaders(uint32_t headers, bool end_of_stream) override;
+      FilterHeadersStatus onResponseHeaders(uint32_t headers, bool end_of_stream) override;
       FilterDataStatus onRequestBody(size_t body_buffer_length, bool end_of_stream) override;
       FilterDataStatus onResponseBody(size_t body_buffer_length, bool end_of_stream) override;
+      FilterTrailersStatus onResponseTrailers(uint32_t trailers) override;
+      bool onDone() override;
+  // Lets the held response through or replaces it, once its inspection
+  // completed or its deadline passed
+  void onVerdict(Verdict verdict);
 
  private:
-  void maybeInspect(Buffer* buffer, bool end_of_stream);
-  void reportExceeded(size_t buffer_size);
+  // Capture state of one direction of the stream
+  struct Capture {
+    // Created on the first captured body chunk
+    std::unique_ptr<Buffer> buffer;
+    // Decision of the capture rules, capturing unless a rule says otherwise
+    CaptureRules::Match match{CaptureRules::NoRule, true, false};
+    // Kept to match the message again once its body size is known
+    std::string content_type;
+    uint32_t status = 0;
+  };
+
+  void collectRequestFields();
+  Verdict enforceResponse();
+  bool applyVerdict(Verdict verdict);
+  void matchCaptureRules(Capture* capture, const MessageProperties& message);
+  // Captures the body_buffer_length - offset bytes at offset in the host
+  // buffer. Returns whether the message is complete and to be inspected.
+  bool captureBody(WasmBufferType type, Capture* capture, Direction direction, size_t offset,
+                   size_t body_buffer_length, bool end_of_stream);
+  void inspect(Buffer* buffer, Direction direction);
+  void reportSkipped(const Capture& capture, size_t size);
+  void reportExceeded(size_t buffer_size, Direction direction);
+  std::string routeName();
 
-  std::unique_ptr<Buffer> request_buffer_;
-  std::unique_ptr<Buffer> response_buffer_;
+  Capture request_;
+  Capture response_;
+  // Request properties the response is matched by, only set with capture
+  // rules
+  std::string method_;
+  std::string path_;
+  std::string host_;
+  // Request fields sent along with the request, only set when coalescing
+  std::vector<RequestField> request_fields_;
+  // Whether the response is held until inspected, and since when its verdict
+  // is awaited, once the response was fully received
+  bool enforced_ = false;
+  uint64_t held_ns_ = 0;
   inline DlpRootContext* rootContext() {
     return dynamic_cast<DlpRootContext*>(this->root());
   };
@@ -0,0 +1,210 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "learned_secrets.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace google { namespace dlp_filter {
+
+namespace {
+uint64_t load(const char* data) {
+  uint64_t word;
+  std::memcpy(&word, data, sizeof(word));
+  return word;
+}
+
+uint64_t rotate(uint64_t x, int bits) {
+  return (x << bits) | (x >> (64 - bits));
+}
+
+// SipHash-2-4 of data under the 128-bit key k0, k1: a keyed one-way function,
+// so neither the value nor its first bytes can be computed back from the hash
+// even knowing the key.
+uint64_t sipHash(uint64_t k0, uint64_t k1, const char* data, size_t size) {
+  uint64_t v0 = k0 ^ 0x736f6d6570736575;
+  uint64_t v1 = k1 ^ 0x646f72616e646f6d;
+  uint64_t v2 = k0 ^ 0x6c7967656e657261;
+  uint64_t v3 = k1 ^ 0x7465646279746573;
+  auto round = [&]() {
+    v0 += v1;
+    v1 = rotate(v1, 13);
+    v1 ^= v0;
+    v0 = rotate(v0, 32);
+    v2 += v3;
+    v3 = rotate(v3, 16);
+    v3 ^= v2;
+    v0 += v3;
+    v3 = rotate(v3, 21);
+    v3 ^= v0;
+    v2 += v1;
+    v1 = rotate(v1, 17);
+    v1 ^= v2;
+    v2 = rotate(v2, 32);
+  };
+  size_t pos = 0;
+  for (; pos + sizeof(uint64_t) <= size; pos += sizeof(uint64_t)) {
+    const uint64_t word = load(data + pos);
+    v3 ^= word;
+    round();
+    round();
+    v0 ^= word;
+  }
+  uint64_t last = 0;
+  std::memcpy(&last, data + pos, size - pos);
+  last |= uint64_t(size) << 56;
+  v3 ^= last;
+  round();
+  round();
+  v0 ^= last;
+  v2 ^= 0xff;
+  round();
+  round();
+  round();
+  round();
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+}
+
+LearnedSecrets::LearnedSecrets(Options options, uint64_t key)
+    : options_(options),
+      key_{key, ~key},
+      filter_(FilterBits / 64) {}
+
+uint64_t LearnedSecrets::anchorHash(const char* data) const {
+  return sipHash(key_[0], key_[1], data, AnchorSize);
+}
+
+uint64_t LearnedSecrets::valueHash(const char* data, size_t size) const {
+  return sipHash(key_[0], key_[1], data, size);
+}
+
+void LearnedSecrets::learn(std::string_view value, std::string_view info_type, uint64_t now_ns) {
+  if (value.size() < AnchorSize || options_.max_entries == 0) {
+    return;
+  }
+  const uint64_t value_hash = valueHash(value.data(), value.size());
+  const uint64_t expires_ns = now_ns + options_.ttl_ns;
+  auto found = entries_.find(value_hash);
+  if (found != entries_.end()) {
+    found->second.expires_ns = expires_ns;
+    found->second.info_type.assign(info_type.data(), info_type.size());
+    return;
+  }
+  if (entries_.size() >= options_.max_entries) {
+    makeRoom(now_ns);
+  }
+  const uint64_t anchor = anchorHash(value.data());
+  entries_.emplace(value_hash, Entry{anchor, value.size(), expires_ns, std::string(info_type)});
+  std::vector<SizeCount>& sizes = anchors_[anchor];
+  auto size = std::find_if(sizes.begin(), sizes.end(),
+                           [&](const SizeCount& size) { return size.size <= value.size(); });
+  if (size != sizes.end() && size->size == value.size()) {
+    size->count++;
+  } else {
+    sizes.insert(size, {value.size(), 1});
+  }
+  const uint64_t bit = anchor >> 48;
+  filter_[bit / 64] |= uint64_t(1) << (bit % 64);
+}
+
+void LearnedSecrets::remove(uint64_t value_hash) {
+  auto found = entries_.find(value_hash);
+  const uint64_t anchor = found->second.anchor;
+  const size_t value_size = found->second.size;
+  entries_.erase(found);
+  auto sizes = anchors_.find(anchor);
+  for (auto size = sizes->second.begin(); size != sizes->second.end(); ++size) {
+    if (size->size == value_size) {
+      if (--size->count == 0) {
+        sizes->second.erase(size);
+      }
+      break;
+    }
+  }
+  if (sizes->second.empty()) {
+    anchors_.erase(sizes);
+  }
+}
+
+void LearnedSecrets::makeRoom(uint64_t now_ns) {
+  std::vector<uint64_t> expired;
+  uint64_t first_expiring = 0;
+  uint64_t first_expires_ns = UINT64_MAX;
+  for (const auto& [value_hash, entry] : entries_) {
+    if (entry.expires_ns <= now_ns) {
+      expired.push_back(value_hash);
+    } else if (entry.expires_ns < first_expires_ns) {
+      first_expiring = value_hash;
+      first_expires_ns = entry.expires_ns;
+    }
+  }
+  for (uint64_t value_hash : expired) {
+    remove(value_hash);
+  }
+  if (entries_.size() >= options_.max_entries) {
+    remove(first_expiring);
+  }
+  rebuildFilter();
+}
+
+void LearnedSecrets::rebuildFilter() {
+  std::fill(filter_.begin(), filter_.end(), 0);
+  for (const auto& [anchor, sizes] : anchors_) {
+    const uint64_t bit = anchor >> 48;
+    filter_[bit / 64] |= uint64_t(1) << (bit % 64);
+  }
+}
+
+void LearnedSecrets::find(
+    std::string_view content, uint64_t now_ns, std::vector<Match>* matches) const {
+  if (entries_.empty() || content.size() < AnchorSize) {
+    return;
+  }
+  const char* data = content.data();
+  size_t pos = 0;
+  while (pos + AnchorSize <= content.size()) {
+    const uint64_t anchor = anchorHash(data + pos);
+    const uint64_t bit = anchor >> 48;
+    if ((filter_[bit / 64] & (uint64_t(1) << (bit % 64))) == 0) {
+      pos++;
+      continue;
+    }
+    auto sizes = anchors_.find(anchor);
+    const Entry* matched = nullptr;
+    if (sizes != anchors_.end()) {
+      // Sizes are sorted longest first, so the longest value starting here
+      // wins.
+      for (const SizeCount& size : sizes->second) {
+        if (pos + size.size > content.size()) {
+          continue;
+        }
+        auto found = entries_.find(valueHash(data + pos, size.size));
+        if (found != entries_.end() && found->second.expires_ns > now_ns) {
+          matched = &found->second;
+          break;
+        }
+      }
+    }
+    if (matched == nullptr) {
+      pos++;
+      continue;
+    }
+    matches->push_back({pos, pos + matched->size, matched->info_type});
+    pos += matched->size;
+  }
+}
+
+}}
@@ -0,0 +1,105 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace google { namespace dlp_filter {
+
+// Values reported in earlier findings, remembered to find them again in later
+// messages without calling Cloud DLP.
+//
+// Only keyed hashes of the values are kept, never the values: a value is known
+// by the SipHash of its first AnchorSize bytes and the SipHash of all of it.
+// Both are one-way, so the values cannot be computed back from the memory of
+// the VM, key included. Content is scanned in a single pass with a window of
+// AnchorSize bytes, whose hash is tested against a bitmap of known anchors
+// before anything else, so positions where no learned value starts cost a
+// single hash of AnchorSize bytes.
+//
+// Values expire ttl_ns after they were last learned. Once max_entries values
+// are kept, learning a new one forgets the value expiring first.
+class LearnedSecrets {
+ public:
+  // Shorter values are not learned, they would match too often.
+  static constexpr size_t AnchorSize = 8;
+
+  struct Options {
+    size_t max_entries;
+    uint64_t ttl_ns;
+  };
+
+  // Learned value found in content, [start, end)
+  struct Match {
+    size_t start;
+    size_t end;
+    // Info type of the finding that reported the value
+    std::string_view info_type;
+  };
+
+  // key makes the hashes unpredictable without it.
+  LearnedSecrets(Options options, uint64_t key);
+
+  void learn(std::string_view value, std::string_view info_type, uint64_t now_ns);
+
+  // Appends the learned values found in content to matches, in order and
+  // without overlaps. Views into the matches stay valid until the next
+  // learn().
+  void find(std::string_view content, uint64_t now_ns, std::vector<Match>* matches) const;
+
+  size_t size() const {
+    return entries_.size();
+  }
+
+ private:
+  struct Entry {
+    uint64_t anchor;
+    size_t size;
+    uint64_t expires_ns;
+    std::string info_type;
+  };
+
+  // Number of values of a size sharing an anchor
+  struct SizeCount {
+    size_t size;
+    size_t count;
+  };
+
+  uint64_t anchorHash(const char* data) const;
+  // Hash of the value, including its size
+  uint64_t valueHash(const char* data, size_t size) const;
+  void remove(uint64_t value_hash);
+  // Drops expired entries, and the one expiring first if still full
+  void makeRoom(uint64_t now_ns);
+  void rebuildFilter();
+
+  static constexpr size_t FilterBits = 1 << 16;
+
+  const Options options_;
+  // SipHash key
+  const uint64_t key_[2];
+  // Entries by value hash, and the sizes of the values starting with each
+  // anchor, longest first. Scanning costs one hash per size of the values
+  // sharing the anchor however many there are.
+  std::unordered_map<uint64_t, Entry> entries_;
+  std::unordered_map<uint64_t, std::vector<SizeCount>> anchors_;
+  // Bit per anchor hash prefix of the entries
+  std::vector<uint64_t> filter_;
+};
+
+}}
@@ -0,0 +1,236 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "minimizer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace google { namespace dlp_filter {
+
+namespace {
+// Digits of the shortest card numbers
+constexpr size_t MinNumberDigits = 13;
+
+// Classes of bytes. Runs are maximal sequences of bytes of one class.
+enum class ByteClass : uint8_t {
+  // Printable ASCII punctuation
+  Other,
+  // Base64 (standard and URL-safe) and hex characters: letters, digits and
+  // + / = - _
+  Token,
+  // Space, \t, \n, \v, \f and \r
+  Space,
+  // Control characters and bytes of 0x80 and above. Only runs holding a
+  // control character are truncated: the others are likely UTF-8 text.
+  Binary,
+};
+
+constexpr bool isControl(uint8_t byte) {
+  return (byte < 0x20 && !(byte == ' ' || (byte >= '\t' && byte <= '\r'))) || byte == 0x7f;
+}
+
+constexpr ByteClass classify(uint8_t byte) {
+  if ((byte >= 'A' && byte <= 'Z') || (byte >= 'a' && byte <= 'z') || (byte >= '0' && byte <= '9')
+      || byte == '+' || byte == '/' || byte == '=' || byte == '-' || byte == '_') {
+    return ByteClass::Token;
+  }
+  if (byte == ' ' || (byte >= '\t' && byte <= '\r')) {
+    return ByteClass::Space;
+  }
+  if (byte >= 0x80 || isControl(byte)) {
+    return ByteClass::Binary;
+  }
+  return ByteClass::Other;
+}
+
+struct ClassTable {
+  constexpr ClassTable() : classes() {
+    for (int i = 0; i < 256; i++) {
+      classes[i] = classify(static_cast<uint8_t>(i));
+    }
+  }
+  ByteClass classes[256];
+};
+
+constexpr ClassTable Classes;
+
+ByteClass classOf(char byte) {
+  return Classes.classes[static_cast<uint8_t>(byte)];
+}
+
+// SWAR helpers over the 8 bytes of a word. Masks have the high bit of every
+// byte that satisfies the predicate set. Comparisons take the word with the
+// high bit of every byte cleared, so adding to a byte never carries into the
+// next one.
+constexpr uint64_t Ones = 0x0101010101010101;
+constexpr uint64_t Highs = 0x8080808080808080;
+
+// Bytes of at least c, for 0 < c <= 0x80
+uint64_t atLeast(uint64_t low, uint8_t c) {
+  return (low + Ones * (0x80 - c)) & Highs;
+}
+
+uint64_t between(uint64_t low, uint8_t first, uint8_t last) {
+  return atLeast(low, first) & ~atLeast(low, last + 1);
+}
+
+uint64_t equal(uint64_t low, uint8_t c) {
+  return ~((low ^ (Ones * c)) + Ones * 0x7f) & Highs;
+}
+
+// Bytes of the word in class byte_class
+uint64_t classMask(uint64_t word, ByteClass byte_class) {
+  const uint64_t high = word & Highs;
+  const uint64_t low = word & ~Highs;
+  const uint64_t space = (equal(low, ' ') | between(low, '\t', '\r')) & ~high;
+  switch (byte_class) {
+    case ByteClass::Token:
+      return (between(low, 'A', 'Z') | between(low, 'a', 'z') | between(low, '0', '9')
+              | equal(low, '+') | equal(low, '/') | equal(low, '=') | equal(low, '-')
+              | equal(low, '_'))
+          & ~high;
+    case ByteClass::Space:
+      return space;
+    case ByteClass::Binary:
+      return high | (((~atLeast(low, 0x20) & Highs & ~space) | equal(low, 0x7f)) & ~high);
+    case ByteClass::Other:
+      break;
+  }
+  return Highs & ~(classMask(word, ByteClass::Token) | space | classMask(word, ByteClass::Binary));
+}
+
+// End of the run of byte_class bytes starting at pos
+size_t runEnd(const char* data, size_t pos, size_t size, ByteClass byte_class) {
+  for (; pos + sizeof(uint64_t) <= size; pos += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, data + pos, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    const uint64_t outside = ~classMask(word, byte_class) & Highs;
+    if (outside != 0) {
+      return pos + __builtin_ctzll(outside) / 8;
+    }
+  }
+  while (pos < size && classOf(data[pos]) == byte_class) {
+    pos++;
+  }
+  return pos;
+}
+
+// Digits and dashes, the bytes of card and account numbers
+constexpr bool isNumberByte(char byte) {
+  return (byte >= '0' && byte <= '9') || byte == '-';
+}
+
+// End of the run of number bytes starting at pos if number, or else of the
+// run of other bytes
+size_t numberRunEnd(const char* data, size_t pos, size_t size, bool number) {
+  for (; pos + sizeof(uint64_t) <= size; pos += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, data + pos, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    const uint64_t low = word & ~Highs;
+    const uint64_t numbers = (between(low, '0', '9') | equal(low, '-')) & ~(word & Highs);
+    const uint64_t outside = (number ? ~numbers : numbers) & Highs;
+    if (outside != 0) {
+      return pos + __builtin_ctzll(outside) / 8;
+    }
+  }
+  while (pos < size && isNumberByte(data[pos]) == number) {
+    pos++;
+  }
+  return pos;
+}
+
+bool hasControl(const char* data, size_t size) {
+  return std::any_of(data, data + size, [](char byte) {
+    return isControl(static_cast<uint8_t>(byte));
+  });
+}
+}
+
+size_t OffsetMap::original(size_t minimized) const {
+  auto it = std::upper_bound(
+      segments_.begin(), segments_.end(), minimized,
+      [](size_t offset, const Segment& segment) { return offset < segment.minimized; });
+  if (it == segments_.begin()) {
+    return minimized;
+  }
+  --it;
+  return it->original + (minimized - it->minimized);
+}
+
+size_t Minimizer::minimize(std::string_view body, std::string* out, OffsetMap* offsets) const {
+  out->clear();
+  out->reserve(body.size());
+  offsets->clear();
+  const char* data = body.data();
+  const size_t size = body.size();
+  // Bytes from copied to pos are kept, and appended once a run is cut.
+  size_t copied = 0;
+  const auto drop = [&](size_t from, size_t to) {
+    out->append(data + copied, from - copied);
+    copied = to;
+    offsets->add(out->size(), to);
+  };
+  size_t pos = 0;
+  while (pos < size) {
+    const ByteClass byte_class = classOf(data[pos]);
+    const size_t end = runEnd(data, pos + 1, size, byte_class);
+    size_t keep = end - pos;
+    if (byte_class == ByteClass::Space) {
+      if (options_.collapse_whitespace) {
+        keep = 1;
+      }
+    } else if (byte_class == ByteClass::Token || byte_class == ByteClass::Binary) {
+      if (options_.max_run_bytes > 0 && keep > options_.max_run_bytes
+          && (byte_class == ByteClass::Token || hasControl(data + pos, keep))) {
+        keep = options_.max_run_bytes;
+      }
+    }
+    size_t cut = pos + keep;
+    if (cut < end && byte_class == ByteClass::Token) {
+      // Numbers long enough to be card or account numbers are kept whole,
+      // wherever they are in the run.
+      size_t number = cut;
+      while (number > pos && isNumberByte(data[number - 1])) {
+        number--;
+      }
+      while (number < end) {
+        const size_t number_end = numberRunEnd(data, number, end, true);
+        const size_t digits = std::count_if(data + number, data + number_end,
+                                            [](char byte) { return byte != '-'; });
+        if (digits >= MinNumberDigits) {
+          if (number > cut) {
+            drop(cut, number);
+          }
+          cut = std::max(cut, number_end);
+        }
+        number = numberRunEnd(data, number_end, end, false);
+      }
+    }
+    if (cut < end) {
+      drop(cut, end);
+    }
+    pos = end;
+  }
+  out->append(data + copied, size - copied);
+  return size - out->size();
+}
+
+}}
@@ -0,0 +1,97 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace google { namespace dlp_filter {
+
+// Maps offsets in a minimized body back to the original body.
+//
+// Holds one segment per place bytes were dropped, so a body minimized without
+// dropping anything has an empty map, which maps every offset to itself.
+class OffsetMap {
+ public:
+  void clear() {
+    segments_.clear();
+  }
+
+  bool empty() const {
+    return segments_.empty();
+  }
+
+  // Records that from minimized offset on, the minimized body continues with
+  // the original body at original. Offsets have to increase between calls.
+  void add(size_t minimized, size_t original) {
+    segments_.push_back({minimized, original});
+  }
+
+  // Original offset of the byte at a minimized offset.
+  size_t original(size_t minimized) const;
+
+  // Original end of a range ending before a minimized offset, so a range
+  // ending where bytes were dropped does not extend over them.
+  size_t originalEnd(size_t minimized_end) const {
+    return minimized_end == 0 ? 0 : original(minimized_end - 1) + 1;
+  }
+
+ private:
+  struct Segment {
+    size_t minimized;
+    size_t original;
+  };
+
+  std::vector<Segment> segments_;
+};
+
+// Shrinks captured bodies before they are sent for inspection, dropping
+// content that inflates requests without helping detection: runs of
+// whitespace, and long runs of base64 or hex characters (embedded images,
+// opaque ids) or of binary bytes.
+//
+// Bodies are read in a single pass, eight bytes at a time: the class of every
+// byte of a word is computed at once with SWAR arithmetic, so long runs are
+// skipped without looking at their bytes one by one. Kept bytes are copied in
+// as few appends as there are dropped runs.
+class Minimizer {
+ public:
+  struct Options {
+    // Replaces every run of whitespace by its first character.
+    bool collapse_whitespace;
+    // Truncates longer runs of base64 or hex characters, and of binary bytes,
+    // to their first max_run_bytes bytes. 0 keeps runs whole. Numbers of at
+    // least 13 digits, possibly split by dashes, are kept in truncated runs:
+    // they may be card or account numbers.
+    size_t max_run_bytes;
+  };
+
+  explicit Minimizer(Options options) : options_(options) {}
+
+  // Whether the options may change a body at all.
+  bool enabled() const {
+    return options_.collapse_whitespace || options_.max_run_bytes > 0;
+  }
+
+  // Writes the minimized body to out and the offsets of its bytes in body to
+  // offsets, replacing their content. Returns the number of bytes dropped.
+  size_t minimize(std::string_view body, std::string* out, OffsetMap* offsets) const;
+
+ private:
+  const Options options_;
+};
+
+}}
@@ -0,0 +1,40 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Registers the filter as a null VM plugin, so that an Envoy binary linking
+// //plugin:filter_null_plugin runs it natively instead of in a Wasm VM.
+//
+// It is selected by the Wasm filter configuration with
+//   vm_config:
+//     runtime: envoy.wasm.runtime.null
+//     code:
+//       local: { inline_string: "envoy.wasm.dlp" }
+// and takes the same plugin configuration as filter.wasm.
+
+#include "include/proxy-wasm/null_plugin.h"
+
+namespace proxy_wasm {
+namespace null_plugin {
+namespace dlp {
+
+NullPluginRegistry* context_registry_;
+
+}  // namespace dlp
+
+RegisterNullVmPluginFactory register_dlp_filter("envoy.wasm.dlp", []() {
+  return std::make_unique<NullPlugin>(dlp::context_registry_);
+});
+
+}  // namespace null_plugin
+}  // namespace proxy_wasm
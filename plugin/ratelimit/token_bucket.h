@@ -0,0 +1,54 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+namespace google { namespace dlp_filter {
+
+// Token bucket allowing rate_per_second events on average and bursts of up
+// to burst events. A rate of 0 allows every event.
+class TokenBucket {
+ public:
+  TokenBucket(uint32_t rate_per_second, uint32_t burst)
+      : rate_per_ns_(rate_per_second / 1e9),
+        burst_(std::max<uint32_t>(burst, 1)),
+        tokens_(burst_),
+        updated_ns_() {}
+
+  // Takes a token if one is available at now_ns.
+  bool tryAcquire(uint64_t now_ns) {
+    if (rate_per_ns_ == 0) {
+      return true;
+    }
+    if (now_ns > updated_ns_) {
+      tokens_ = std::min<double>(burst_, tokens_ + (now_ns - updated_ns_) * rate_per_ns_);
+      updated_ns_ = now_ns;
+    }
+    if (tokens_ < 1) {
+      return false;
+    }
+    tokens_ -= 1;
+    return true;
+  }
+
+ private:
+  const double rate_per_ns_;
+  const uint32_t burst_;
+  double tokens_;
+  uint64_t updated_ns_;
+};
+
+}}
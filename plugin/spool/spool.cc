@@ -0,0 +1,220 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "spool.h"
+
+#include <algorithm>
+
+namespace google { namespace dlp_filter {
+
+namespace {
+// Attempts of a push racing with other workers
+static const int MaxPushAttempts = 8;
+// Most entries claimed by one drain
+static const uint64_t MaxDrainEntries = 64;
+static const uint64_t NanosPerSecond = 1000000000;
+static const size_t MetaSize = 40;
+// Sequence number and spool time
+static const size_t EntryHeaderSize = 16;
+
+void appendUint64(std::string* out, uint64_t value) {
+  for (int i = 0; i < 8; i++) {
+    out->push_back(static_cast<char>(value >> (8 * i)));
+  }
+}
+
+uint64_t readUint64(std::string_view in, size_t offset) {
+  uint64_t value = 0;
+  for (int i = 0; i < 8; i++) {
+    value |= static_cast<uint64_t>(static_cast<uint8_t>(in[offset + i])) << (8 * i);
+  }
+  return value;
+}
+}
+
+void SpoolMessage::appendTo(std::string* out) const {
+  const size_t route_size = std::min<size_t>(route.size(), UINT16_MAX);
+  out->reserve(out->size() + 4 + route_size + body.size());
+  out->push_back(static_cast<char>(operations));
+  out->push_back(static_cast<char>(direction));
+  out->push_back(static_cast<char>(route_size));
+  out->push_back(static_cast<char>(route_size >> 8));
+  out->append(route.data(), route_size);
+  out->append(body.data(), body.size());
+}
+
+bool SpoolMessage::parse(std::string_view payload, SpoolMessage* message) {
+  if (payload.size() < 4) {
+    return false;
+  }
+  const size_t route_size =
+      static_cast<uint8_t>(payload[2]) | static_cast<uint8_t>(payload[3]) << 8;
+  if (payload.size() < 4 + route_size) {
+    return false;
+  }
+  message->operations = static_cast<uint8_t>(payload[0]);
+  message->direction = static_cast<uint8_t>(payload[1]);
+  message->route = payload.substr(4, route_size);
+  message->body = payload.substr(4 + route_size);
+  return true;
+}
+
+Spool::Spool(SharedStore* store, std::string key_prefix, Options options)
+    : store_(store),
+      meta_key_(key_prefix + "meta"),
+      slot_prefix_(key_prefix + "slot."),
+      options_(options),
+      missing_seq_(UINT64_MAX) {}
+
+void Spool::init() {
+  uint32_t cas;
+  if (!store_->get(meta_key_, &value_, &cas)) {
+    writeMeta({0, 0, 0, 0, 0}, 0);
+  }
+}
+
+bool Spool::readMeta(Meta* meta, uint32_t* cas) {
+  if (!store_->get(meta_key_, &value_, cas) || value_.size() != MetaSize) {
+    return false;
+  }
+  *meta = {readUint64(value_, 0), readUint64(value_, 8), readUint64(value_, 16),
+           readUint64(value_, 24), readUint64(value_, 32)};
+  return true;
+}
+
+bool Spool::writeMeta(const Meta& meta, uint32_t cas) {
+  value_.clear();
+  appendUint64(&value_, meta.head);
+  appendUint64(&value_, meta.tail);
+  appendUint64(&value_, meta.bytes);
+  appendUint64(&value_, meta.head_spooled_ns);
+  appendUint64(&value_, meta.drain_ns);
+  return store_->set(meta_key_, value_, cas);
+}
+
+const std::string& Spool::slotKey(uint64_t seq) {
+  key_ = slot_prefix_;
+  key_ += std::to_string(seq % options_.max_entries);
+  return key_;
+}
+
+bool Spool::readEntry(uint64_t seq, uint64_t* spooled_ns, uint32_t* cas) {
+  if (!store_->get(slotKey(seq), &value_, cas)
+      || value_.size() < EntryHeaderSize || readUint64(value_, 0) != seq) {
+    return false;
+  }
+  *spooled_ns = readUint64(value_, 8);
+  return true;
+}
+
+bool Spool::push(uint64_t spooled_ns, std::string_view payload) {
+  for (int attempt = 0; attempt < MaxPushAttempts; attempt++) {
+    Meta meta;
+    uint32_t cas;
+    if (!readMeta(&meta, &cas)
+        || meta.tail - meta.head >= options_.max_entries
+        || meta.bytes + payload.size() > options_.max_bytes) {
+      return false;
+    }
+    const uint64_t seq = meta.tail;
+    if (meta.head == meta.tail) {
+      meta.head_spooled_ns = spooled_ns;
+    }
+    meta.tail++;
+    meta.bytes += payload.size();
+    if (!writeMeta(meta, cas)) {
+      continue;
+    }
+    value_.clear();
+    appendUint64(&value_, seq);
+    appendUint64(&value_, spooled_ns);
+    value_.append(payload.data(), payload.size());
+    store_->set(slotKey(seq), value_, 0);
+    return true;
+  }
+  return false;
+}
+
+void Spool::drain(uint64_t now_ns, std::vector<Entry>* entries, std::vector<Entry>* expired) {
+  entries->clear();
+  expired->clear();
+  Meta meta;
+  uint32_t meta_cas;
+  if (!readMeta(&meta, &meta_cas) || meta.head == meta.tail) {
+    return;
+  }
+  const uint64_t interval_ns = NanosPerSecond / std::max<uint32_t>(options_.drain_per_second, 1);
+  // Unused rate does not accumulate beyond one second, so that recovering
+  // from an outage starts at the configured rate.
+  const uint64_t start_ns = std::max(meta.drain_ns, now_ns - std::min(now_ns, NanosPerSecond));
+  const uint64_t allowance = (now_ns - start_ns) / interval_ns;
+
+  // Read the entries to claim, with the versions to clear them by.
+  std::vector<std::pair<uint64_t, uint32_t>> claimed;
+  uint64_t seq = meta.head;
+  uint64_t freed_bytes = 0;
+  // Spool time of the entry left at the head
+  uint64_t head_spooled_ns = 0;
+  for (; seq < meta.tail; seq++) {
+    uint64_t spooled_ns;
+    uint32_t cas;
+    if (!readEntry(seq, &spooled_ns, &cas)) {
+      if (seq != missing_seq_) {
+        missing_seq_ = seq;
+        break;
+      }
+      continue;
+    }
+    const bool is_expired = now_ns - std::min(now_ns, spooled_ns) > options_.max_age_ns;
+    if ((!is_expired && entries->size() >= allowance) || claimed.size() >= MaxDrainEntries) {
+      head_spooled_ns = spooled_ns;
+      break;
+    }
+    (is_expired ? expired : entries)->push_back({spooled_ns, value_.substr(EntryHeaderSize)});
+    freed_bytes += value_.size() - EntryHeaderSize;
+    claimed.emplace_back(seq, cas);
+  }
+  if (seq == meta.head) {
+    return;
+  }
+
+  meta.head = seq;
+  // Abandoned entries are not counted, so the total is reset once empty.
+  meta.bytes = meta.head == meta.tail ? 0 : meta.bytes - std::min(meta.bytes, freed_bytes);
+  meta.head_spooled_ns = head_spooled_ns;
+  meta.drain_ns = start_ns + entries->size() * interval_ns;
+  if (!writeMeta(meta, meta_cas)) {
+    // Another worker changed the spool meanwhile; try again next time.
+    entries->clear();
+    expired->clear();
+    return;
+  }
+  // Free the slots unless a push already reused them.
+  for (const auto& [claimed_seq, cas] : claimed) {
+    store_->set(slotKey(claimed_seq), "", cas);
+  }
+}
+
+Spool::Depth Spool::depth(uint64_t now_ns) {
+  Meta meta;
+  uint32_t cas;
+  if (!readMeta(&meta, &cas) || meta.head == meta.tail) {
+    return {0, 0, 0};
+  }
+  const uint64_t age_ns =
+      meta.head_spooled_ns > 0 ? now_ns - std::min(now_ns, meta.head_spooled_ns) : 0;
+  return {meta.tail - meta.head, meta.bytes, age_ns};
+}
+
+}}
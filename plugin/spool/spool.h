@@ -0,0 +1,130 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace google { namespace dlp_filter {
+
+// Key-value store shared by all proxy workers, such as proxy-wasm shared
+// data. Every value has a version that changes on each write.
+class SharedStore {
+ public:
+  virtual ~SharedStore() = default;
+
+  // Reads a value and its version. Returns false if the key was never set.
+  virtual bool get(std::string_view key, std::string* value, uint32_t* cas) = 0;
+
+  // Writes a value if its version is still cas, or unconditionally if cas is
+  // 0. Returns false on a version mismatch.
+  virtual bool set(std::string_view key, std::string_view value, uint32_t cas) = 0;
+};
+
+// Captured message as stored in the spool
+struct SpoolMessage {
+  // Bit mask of the operations the message is still to be sent to
+  uint8_t operations;
+  uint8_t direction;
+  std::string_view route;
+  std::string_view body;
+
+  void appendTo(std::string* out) const;
+
+  // Views point into payload. Returns false if it is malformed.
+  static bool parse(std::string_view payload, SpoolMessage* message);
+};
+
+// Bounded FIFO of messages in a SharedStore, shared by all proxy workers.
+//
+// Entries live in a ring of max_entries keys next to a meta key holding the
+// head and tail sequence numbers, the total size, the age of the head entry
+// and the drain schedule, so that depth() only reads the meta key.
+// Every change of the meta key is a compare-and-swap, so workers can push and
+// drain concurrently: a push reserves a sequence number and then writes its
+// entry, a drain reads the entries at the head and then claims them.
+//
+// Draining is paced for all workers together: drain() returns at most
+// drain_per_second entries per second in total, plus any entries older than
+// max_age_ns, which are returned as expired rather than to be sent again.
+class Spool {
+ public:
+  struct Options {
+    uint64_t max_bytes;
+    uint32_t max_entries;
+    uint64_t max_age_ns;
+    uint32_t drain_per_second;
+  };
+
+  struct Entry {
+    // When the message was first spooled, kept when it is spooled again
+    uint64_t spooled_ns;
+    std::string payload;
+  };
+
+  struct Depth {
+    uint64_t entries;
+    uint64_t bytes;
+    // Age of the oldest entry, 0 if empty or unknown
+    uint64_t oldest_age_ns;
+  };
+
+  Spool(SharedStore* store, std::string key_prefix, Options options);
+
+  // Creates the meta key unless another worker did.
+  void init();
+
+  // Appends an entry. Returns false if the spool is full.
+  bool push(uint64_t spooled_ns, std::string_view payload);
+
+  // Claims the entries at the head that are due at now_ns. Entries are
+  // appended to entries or expired, which are cleared first.
+  void drain(uint64_t now_ns, std::vector<Entry>* entries, std::vector<Entry>* expired);
+
+  Depth depth(uint64_t now_ns);
+
+ private:
+  struct Meta {
+    uint64_t head;
+    uint64_t tail;
+    uint64_t bytes;
+    // Spool time of the head entry, 0 if unknown
+    uint64_t head_spooled_ns;
+    // Time up to which the drain rate has been used
+    uint64_t drain_ns;
+  };
+
+  bool readMeta(Meta* meta, uint32_t* cas);
+  bool writeMeta(const Meta& meta, uint32_t cas);
+  const std::string& slotKey(uint64_t seq);
+  // Reads the entry with the given sequence number. Returns false if its
+  // slot holds anything else, e.g. while its push is in progress.
+  bool readEntry(uint64_t seq, uint64_t* spooled_ns, uint32_t* cas);
+
+  SharedStore* store_;
+  const std::string meta_key_;
+  const std::string slot_prefix_;
+  const Options options_;
+  // Sequence number found missing at the previous drain. A push writes its
+  // entry right after reserving it, so an entry still missing a drain later
+  // was abandoned and is skipped.
+  uint64_t missing_seq_;
+  // Reused buffers
+  std::string key_;
+  std::string value_;
+};
+
+}}
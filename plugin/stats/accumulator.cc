@@ -0,0 +1,39 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "accumulator.h"
+
+namespace google { namespace dlp_filter {
+
+uint32_t StatAccumulator::slot(uint32_t metric_id) {
+  auto it = slots_.find(metric_id);
+  if (it != slots_.end()) {
+    return it->second;
+  }
+  const uint32_t slot = static_cast<uint32_t>(metric_ids_.size());
+  metric_ids_.push_back(metric_id);
+  deltas_.push_back(0);
+  slots_.emplace(metric_id, slot);
+  return slot;
+}
+
+void StatAccumulator::flush() {
+  for (uint32_t slot : dirty_) {
+    recorder_(metric_ids_[slot], deltas_[slot]);
+    deltas_[slot] = 0;
+  }
+  dirty_.clear();
+}
+
+}}
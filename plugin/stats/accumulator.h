@@ -0,0 +1,80 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace google { namespace dlp_filter {
+
+// Sums counter increments inside the VM and reports them to the host in
+// batches.
+//
+// Every metric id gets a slot; add() is then an integer addition and flush()
+// makes one host call per metric that changed since the previous flush.
+// When not buffered, add() reports each increment right away.
+class StatAccumulator {
+ public:
+  // Reports an increment of the counter with the given metric id to the host.
+  using Recorder = std::function<void(uint32_t metric_id, uint64_t value)>;
+
+  StatAccumulator(Recorder recorder, bool buffered)
+      : recorder_(std::move(recorder)),
+        buffered_(buffered) {}
+
+  // Slot of a metric id, to be passed to add(). Returns the same slot for
+  // the same id.
+  uint32_t slot(uint32_t metric_id);
+
+  // Zero increments are dropped, so they cost no host call.
+  void add(uint32_t slot, uint64_t value) {
+    if (value == 0) {
+      return;
+    }
+    if (!buffered_) {
+      recorder_(metric_ids_[slot], value);
+      return;
+    }
+    if (deltas_[slot] == 0) {
+      dirty_.push_back(slot);
+    }
+    deltas_[slot] += value;
+  }
+
+  // Reports and clears all increments added since the previous flush.
+  void flush();
+
+  bool buffered() const {
+    return buffered_;
+  }
+
+  // Number of slots with increments not yet reported.
+  size_t pending() const {
+    return dirty_.size();
+  }
+
+ private:
+  const Recorder recorder_;
+  const bool buffered_;
+  std::unordered_map<uint32_t, uint32_t> slots_;
+  // Metric id and accumulated increment by slot
+  std::vector<uint32_t> metric_ids_;
+  std::vector<uint64_t> deltas_;
+  // Slots with a non-zero increment
+  std::vector<uint32_t> dirty_;
+};
+
+}}
@@ -0,0 +1,94 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tagged_metric.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace google { namespace dlp_filter {
+
+namespace {
+static const size_t MaxLabelLength = 63;
+static const size_t MaxTagValues = UINT16_MAX;
+}
+
+std::string formatLabel(std::string_view label) {
+  std::string canonical_label(label.substr(0, std::min(MaxLabelLength, label.length())));
+  if (!canonical_label.empty() && !std::isalpha(static_cast<unsigned char>(canonical_label[0]))) {
+    canonical_label[0] = 'x';
+  }
+  std::for_each(canonical_label.begin(), canonical_label.end(), [](char& c) {
+    const unsigned char u = static_cast<unsigned char>(c);
+    if (std::isupper(u)) {
+      c = static_cast<char>(std::tolower(u));
+    }
+    if (!(std::isalnum(u) || c == '_' || c == '-')) {
+      c = '_';
+    }
+  });
+  return canonical_label;
+}
+
+TagValues::TagValues(std::string name, size_t max_values)
+    : name_(std::move(name)),
+      max_values_(std::min(max_values, MaxTagValues)),
+      values_({Overflow}) {}
+
+uint16_t TagValues::index(std::string_view value) {
+  lookup_key_.assign(value.data(), value.size());
+  auto it = indices_.find(lookup_key_);
+  if (it != indices_.end()) {
+    return it->second;
+  }
+  if (size() >= max_values_) {
+    return 0;
+  }
+  const uint16_t index = static_cast<uint16_t>(values_.size());
+  values_.push_back(formatLabel(value));
+  indices_.emplace(lookup_key_, index);
+  return index;
+}
+
+TaggedMetric::TaggedMetric(std::string name, std::vector<TagValues*> tags, Resolver resolver)
+    : name_(std::move(name)),
+      tags_(std::move(tags)),
+      resolver_(std::move(resolver)) {}
+
+uint32_t TaggedMetric::id(std::initializer_list<uint16_t> indices) {
+  uint64_t key = 0;
+  for (uint16_t index : indices) {
+    key = (key << 16) | index;
+  }
+  auto it = ids_.find(key);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+
+  std::string full_name;
+  size_t tag = 0;
+  for (uint16_t index : indices) {
+    full_name += tags_[tag]->name();
+    full_name += '.';
+    full_name += tags_[tag]->value(index);
+    full_name += '.';
+    tag++;
+  }
+  full_name += name_;
+  const uint32_t id = resolver_(full_name);
+  ids_.emplace(key, id);
+  return id;
+}
+
+}}
@@ -0,0 +1,103 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace google { namespace dlp_filter {
+
+// Turns an arbitrary value into a metric label: at most 63 characters of
+// [a-z0-9_-], starting with a letter.
+std::string formatLabel(std::string_view label);
+
+// Bounded set of values of one metric tag.
+//
+// Values are numbered in the order they are first seen. Once max_values
+// distinct values are known, any new value is reported as the overflow value
+// (index 0), so a tag never adds more than max_values + 1 series to a metric.
+class TagValues {
+ public:
+  static constexpr char Overflow[] = "other";
+
+  TagValues(std::string name, size_t max_values);
+
+  // Index of the value, 0 if it is not tracked.
+  uint16_t index(std::string_view value);
+
+  // Formatted value for an index returned by index().
+  const std::string& value(uint16_t index) const {
+    return values_[index];
+  }
+
+  const std::string& name() const {
+    return name_;
+  }
+
+  // Number of tracked values, not counting the overflow value.
+  size_t size() const {
+    return values_.size() - 1;
+  }
+
+ private:
+  const std::string name_;
+  const size_t max_values_;
+  // Raw value to index
+  std::unordered_map<std::string, uint16_t> indices_;
+  // Formatted values by index
+  std::vector<std::string> values_;
+  // Reused for lookups so that known values are found without allocating
+  std::string lookup_key_;
+};
+
+// Metric with a fixed list of tags, whose ids are resolved on first use of
+// each combination of tag values and cached.
+//
+// The full metric name follows the proxy-wasm SDK convention
+// "<tag>.<value>.[<tag>.<value>.]<name>", as used by its Counter<Tags...>.
+class TaggedMetric {
+ public:
+  static constexpr size_t MaxTags = 4;
+
+  // Defines a metric with the given full name and returns the id it is
+  // recorded by, e.g. the host metric id or a StatAccumulator slot.
+  using Resolver = std::function<uint32_t(const std::string& full_name)>;
+
+  // Tag tables are not owned and can be shared between metrics. At most
+  // MaxTags tags are supported.
+  TaggedMetric(std::string name, std::vector<TagValues*> tags, Resolver resolver);
+
+  // Id of the metric for tag value indices as returned by TagValues::index(),
+  // one per tag, in tag order.
+  uint32_t id(std::initializer_list<uint16_t> indices);
+
+  // Number of metric ids resolved so far.
+  size_t size() const {
+    return ids_.size();
+  }
+
+ private:
+  const std::string name_;
+  const std::vector<TagValues*> tags_;
+  const Resolver resolver_;
+  // Tag value indices packed 16 bits each, to metric id
+  std::unordered_map<uint64_t, uint32_t> ids_;
+};
+
+}}
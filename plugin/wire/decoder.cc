@@ -0,0 +1,226 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder.h"
+
+namespace google { namespace dlp_filter {
+
+namespace {
+// Field numbers from google/privacy/dlp/v2/dlp.proto
+// InspectContentResponse
+static const uint32_t ResponseResult = 1;
+// InspectResult
+static const uint32_t ResultFindings = 1;
+// Finding
+static const uint32_t FindingQuote = 1;
+static const uint32_t FindingInfoType = 2;
+static const uint32_t FindingLikelihood = 3;
+static const uint32_t FindingLocation = 4;
+// InfoType
+static const uint32_t InfoTypeName = 1;
+// Location
+static const uint32_t LocationByteRange = 1;
+static const uint32_t LocationContentLocations = 7;
+// ContentLocation
+static const uint32_t ContentLocationRecordLocation = 2;
+// RecordLocation
+static const uint32_t RecordLocationFieldId = 2;
+static const uint32_t RecordLocationTableLocation = 3;
+// FieldId
+static const uint32_t FieldIdName = 1;
+// TableLocation
+static const uint32_t TableLocationRowIndex = 1;
+// Range
+static const uint32_t RangeStart = 1;
+static const uint32_t RangeEnd = 2;
+
+// Calls on_field(field_number, type, reader) for every field of the message.
+// on_field has to consume the field value, e.g. by calling reader.skip(type).
+template <typename Callback>
+bool forEachField(std::string_view message, Callback on_field) {
+  wire::Reader reader(message);
+  while (!reader.done()) {
+    uint32_t field_number;
+    wire::WireType type;
+    if (!reader.readTag(&field_number, &type) || !on_field(field_number, type, reader)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool readInfoType(std::string_view message, FindingView* finding) {
+  return forEachField(message, [&](uint32_t field, wire::WireType type, wire::Reader& reader) {
+    if (field == InfoTypeName && type == wire::LengthDelimited) {
+      return reader.readLengthDelimited(&finding->info_type);
+    }
+    return reader.skip(type);
+  });
+}
+
+bool readRange(std::string_view message, FindingView* finding) {
+  finding->has_byte_range = true;
+  return forEachField(message, [&](uint32_t field, wire::WireType type, wire::Reader& reader) {
+    uint64_t value;
+    if (field == RangeStart && type == wire::Varint) {
+      if (!reader.readVarint(&value)) {
+        return false;
+      }
+      finding->byte_range_start = static_cast<int64_t>(value);
+      return true;
+    } else if (field == RangeEnd && type == wire::Varint) {
+      if (!reader.readVarint(&value)) {
+        return false;
+      }
+      finding->byte_range_end = static_cast<int64_t>(value);
+      return true;
+    }
+    return reader.skip(type);
+  });
+}
+
+bool readFieldId(std::string_view message, FindingView* finding) {
+  return forEachField(message, [&](uint32_t field, wire::WireType type, wire::Reader& reader) {
+    if (field == FieldIdName && type == wire::LengthDelimited) {
+      return reader.readLengthDelimited(&finding->field);
+    }
+    return reader.skip(type);
+  });
+}
+
+bool readTableLocation(std::string_view message, FindingView* finding) {
+  return forEachField(message, [&](uint32_t field, wire::WireType type, wire::Reader& reader) {
+    uint64_t value;
+    if (field == TableLocationRowIndex && type == wire::Varint) {
+      if (!reader.readVarint(&value)) {
+        return false;
+      }
+      finding->row_index = static_cast<int64_t>(value);
+      return true;
+    }
+    return reader.skip(type);
+  });
+}
+
+bool readRecordLocation(std::string_view message, FindingView* finding) {
+  finding->has_table_location = true;
+  return forEachField(message, [&](uint32_t field, wire::WireType type, wire::Reader& reader) {
+    std::string_view nested;
+    if (field == RecordLocationFieldId && type == wire::LengthDelimited) {
+      return reader.readLengthDelimited(&nested) && readFieldId(nested, finding);
+    } else if (field == RecordLocationTableLocation && type == wire::LengthDelimited) {
+      return reader.readLengthDelimited(&nested) && readTableLocation(nested, finding);
+    }
+    return reader.skip(type);
+  });
+}
+
+bool readContentLocation(std::string_view message, FindingView* finding) {
+  return forEachField(message, [&](uint32_t field, wire::WireType type, wire::Reader& reader) {
+    std::string_view record_location;
+    if (field == ContentLocationRecordLocation && type == wire::LengthDelimited
+        && !finding->has_table_location) {
+      return reader.readLengthDelimited(&record_location)
+          && readRecordLocation(record_location, finding);
+    }
+    return reader.skip(type);
+  });
+}
+
+bool readLocation(std::string_view message, FindingView* finding) {
+  return forEachField(message, [&](uint32_t field, wire::WireType type, wire::Reader& reader) {
+    std::string_view nested;
+    if (field == LocationByteRange && type == wire::LengthDelimited) {
+      return reader.readLengthDelimited(&nested) && readRange(nested, finding);
+    } else if (field == LocationContentLocations && type == wire::LengthDelimited) {
+      return reader.readLengthDelimited(&nested) && readContentLocation(nested, finding);
+    }
+    return reader.skip(type);
+  });
+}
+
+bool readFinding(std::string_view message, FindingView* finding) {
+  *finding = FindingView();
+  return forEachField(message, [&](uint32_t field, wire::WireType type, wire::Reader& reader) {
+    std::string_view nested;
+    uint64_t value;
+    if (field == FindingQuote && type == wire::LengthDelimited) {
+      return reader.readLengthDelimited(&finding->quote);
+    } else if (field == FindingInfoType && type == wire::LengthDelimited) {
+      return reader.readLengthDelimited(&nested) && readInfoType(nested, finding);
+    } else if (field == FindingLikelihood && type == wire::Varint) {
+      if (!reader.readVarint(&value)) {
+        return false;
+      }
+      finding->likelihood = static_cast<int>(value);
+      return true;
+    } else if (field == FindingLocation && type == wire::LengthDelimited) {
+      return reader.readLengthDelimited(&nested) && readLocation(nested, finding);
+    }
+    return reader.skip(type);
+  });
+}
+}
+
+bool InspectContentResponseScanner::next(FindingView* finding) {
+  if (malformed_) {
+    return false;
+  }
+  while (true) {
+    while (!result_.done()) {
+      uint32_t field;
+      wire::WireType type;
+      if (!result_.readTag(&field, &type)) {
+        return fail();
+      }
+      if (field == ResultFindings && type == wire::LengthDelimited) {
+        std::string_view message;
+        if (!result_.readLengthDelimited(&message) || !readFinding(message, finding)) {
+          return fail();
+        }
+        return true;
+      } else if (!result_.skip(type)) {
+        return fail();
+      }
+    }
+    if (!nextResult()) {
+      return false;
+    }
+  }
+}
+
+// Opens the next InspectResult. A result field occurring more than once is
+// merged by protobuf parsers, so findings of every occurrence are returned.
+bool InspectContentResponseScanner::nextResult() {
+  while (!response_.done()) {
+    uint32_t field;
+    wire::WireType type;
+    if (!response_.readTag(&field, &type)) {
+      return fail();
+    }
+    if (field == ResponseResult && type == wire::LengthDelimited) {
+      std::string_view result;
+      if (!response_.readLengthDelimited(&result)) {
+        return fail();
+      }
+      result_ = wire::Reader(result);
+      return true;
+    } else if (!response_.skip(type)) {
+      return fail();
+    }
+  }
+  return false;
+}
+
+}}
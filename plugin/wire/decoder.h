@@ -0,0 +1,79 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include "wire.h"
+
+namespace google { namespace dlp_filter {
+
+// Fields of a single google.privacy.dlp.v2.Finding read by the filter.
+// Views point into the scanned response and are only valid as long as it is.
+struct FindingView {
+  // InfoType.name, e.g. "US_SOCIAL_SECURITY_NUMBER"
+  std::string_view info_type;
+  // Content that matched, only returned when the request included quotes
+  std::string_view quote;
+  // google.privacy.dlp.v2.Likelihood enum value
+  int likelihood = 0;
+  // Location.byte_range, [start, end) in the inspected content
+  bool has_byte_range = false;
+  int64_t byte_range_start = 0;
+  int64_t byte_range_end = 0;
+  // RecordLocation of findings in a table: FieldId.name of the column and
+  // TableLocation.row_index, from the first content location that has one
+  bool has_table_location = false;
+  std::string_view field;
+  int64_t row_index = 0;
+};
+
+// Walks a serialized google.privacy.dlp.v2.InspectContentResponse in place and
+// yields its findings one at a time.
+//
+// Nothing is allocated and fields other than the ones in FindingView (content
+// locations, timestamps, ...) are skipped without being decoded.
+class InspectContentResponseScanner {
+ public:
+  InspectContentResponseScanner(const char* data, size_t size)
+      : response_(data, data + size),
+        result_(data, data),
+        malformed_() {}
+
+  // Reads the next finding into finding.
+  // Returns false once all findings were read or when the response is
+  // malformed, which can be told apart with malformed().
+  bool next(FindingView* finding);
+
+  // Whether scanning stopped on invalid wire format.
+  bool malformed() const {
+    return malformed_;
+  }
+
+ private:
+  bool nextResult();
+  bool fail() {
+    malformed_ = true;
+    return false;
+  }
+
+  // Unread part of the InspectContentResponse
+  wire::Reader response_;
+  // Unread part of the current InspectResult
+  wire::Reader result_;
+  bool malformed_;
+};
+
+}}
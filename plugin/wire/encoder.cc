@@ -0,0 +1,238 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "encoder.h"
+
+#include "wire.h"
+
+namespace google { namespace dlp_filter {
+
+namespace {
+// Field numbers from google/privacy/dlp/v2/dlp.proto
+// InspectContentRequest
+static const uint32_t RequestParent = 1;
+static const uint32_t RequestInspectConfig = 2;
+static const uint32_t RequestItem = 3;
+static const uint32_t RequestInspectTemplateName = 4;
+static const uint32_t RequestLocationId = 5;
+// InspectConfig
+static const uint32_t InspectConfigIncludeQuote = 4;
+// ContentItem
+static const uint32_t ContentItemByteItem = 5;
+static const uint32_t ContentItemTable = 4;
+// ByteContentItem
+static const uint32_t ByteContentItemData = 2;
+// Table
+static const uint32_t TableHeaders = 1;
+static const uint32_t TableRows = 2;
+// Table.Row
+static const uint32_t RowValues = 1;
+// Value
+static const uint32_t ValueStringValue = 3;
+// FieldId
+static const uint32_t FieldIdName = 1;
+// HybridInspectJobTriggerRequest
+static const uint32_t HybridRequestName = 1;
+static const uint32_t HybridRequestHybridItem = 3;
+// HybridContentItem
+static const uint32_t HybridContentItemItem = 1;
+
+// Encoding of U+FFFD REPLACEMENT CHARACTER
+static constexpr char Replacement[] = "\xef\xbf\xbd";
+
+// Upper bound of tags and length prefixes around the data.
+static const size_t MaxItemOverhead = 3 * (1 + 10);
+
+size_t byteItemSize(size_t size) {
+  return size > 0 ? wire::lengthDelimitedSize(ByteContentItemData, size) : 0;
+}
+
+// Length of the valid UTF-8 sequence starting at data[i], 0 if invalid.
+size_t utf8SequenceLength(std::string_view data, size_t i) {
+  const unsigned char c = static_cast<unsigned char>(data[i]);
+  size_t length;
+  uint32_t min_code_point;
+  uint32_t code_point;
+  if (c < 0x80) {
+    return 1;
+  } else if ((c & 0xe0) == 0xc0) {
+    length = 2;
+    min_code_point = 0x80;
+    code_point = c & 0x1f;
+  } else if ((c & 0xf0) == 0xe0) {
+    length = 3;
+    min_code_point = 0x800;
+    code_point = c & 0x0f;
+  } else if ((c & 0xf8) == 0xf0) {
+    length = 4;
+    min_code_point = 0x10000;
+    code_point = c & 0x07;
+  } else {
+    return 0;
+  }
+  if (i + length > data.size()) {
+    return 0;
+  }
+  for (size_t k = 1; k < length; k++) {
+    const unsigned char next = static_cast<unsigned char>(data[i + k]);
+    if ((next & 0xc0) != 0x80) {
+      return 0;
+    }
+    code_point = (code_point << 6) | (next & 0x3f);
+  }
+  // Overlong encodings, surrogates and values beyond Unicode are invalid.
+  if (code_point < min_code_point || code_point > 0x10ffff
+      || (code_point >= 0xd800 && code_point <= 0xdfff)) {
+    return 0;
+  }
+  return length;
+}
+
+// Whether data is valid UTF-8, or else a copy with invalid bytes replaced.
+bool sanitizeUtf8(std::string_view data, std::string* sanitized) {
+  size_t i = 0;
+  while (i < data.size()) {
+    const size_t length = utf8SequenceLength(data, i);
+    if (length == 0) {
+      break;
+    }
+    i += length;
+  }
+  if (i == data.size()) {
+    return true;
+  }
+  sanitized->assign(data.data(), i);
+  while (i < data.size()) {
+    const size_t length = utf8SequenceLength(data, i);
+    if (length == 0) {
+      sanitized->append(Replacement);
+      i++;
+    } else {
+      sanitized->append(data.data() + i, length);
+      i += length;
+    }
+  }
+  return false;
+}
+
+size_t valueSize(std::string_view value) {
+  return wire::lengthDelimitedSize(ValueStringValue, value.size());
+}
+}
+
+InspectContentRequestEncoder::InspectContentRequestEncoder(
+    std::string_view parent,
+    std::string_view inspect_template_name,
+    std::string_view location_id,
+    bool include_quote) {
+  wire::appendNonEmpty(&prefix_, RequestParent, parent);
+  if (include_quote) {
+    std::string inspect_config;
+    wire::appendTag(&inspect_config, InspectConfigIncludeQuote, wire::Varint);
+    wire::appendVarint(&inspect_config, 1);
+    wire::appendLengthDelimited(&prefix_, RequestInspectConfig, inspect_config);
+  }
+  wire::appendNonEmpty(&suffix_, RequestInspectTemplateName, inspect_template_name);
+  wire::appendNonEmpty(&suffix_, RequestLocationId, location_id);
+}
+
+void InspectContentRequestEncoder::reserve(size_t max_data_size) {
+  output_.reserve(prefix_.size() + MaxItemOverhead + max_data_size + suffix_.size());
+}
+
+std::string_view InspectContentRequestEncoder::encode(const char* data, size_t size) {
+  const size_t byte_item_size = byteItemSize(size);
+  const size_t content_item_size =
+      wire::lengthDelimitedSize(ContentItemByteItem, byte_item_size);
+
+  output_.clear();
+  reserve(size);
+  output_.append(prefix_);
+  wire::appendLengthDelimitedHeader(&output_, RequestItem, content_item_size);
+  wire::appendLengthDelimitedHeader(&output_, ContentItemByteItem, byte_item_size);
+  if (size > 0) {
+    wire::appendLengthDelimitedHeader(&output_, ByteContentItemData, size);
+    output_.append(data, size);
+  }
+  output_.append(suffix_);
+  return output_;
+}
+
+std::string_view InspectContentRequestEncoder::encode(const TableEncoder& table) {
+  output_.clear();
+  output_.append(prefix_);
+  wire::appendLengthDelimitedHeader(
+      &output_, RequestItem, wire::lengthDelimitedSize(ContentItemTable, table.size()));
+  wire::appendLengthDelimitedHeader(&output_, ContentItemTable, table.size());
+  table.appendTo(&output_);
+  output_.append(suffix_);
+  return output_;
+}
+
+TableEncoder::TableEncoder(const std::vector<std::string>& headers)
+    : row_count_(),
+      sanitized_values_(headers.size()) {
+  for (const std::string& header : headers) {
+    wire::appendLengthDelimitedHeader(
+        &headers_, TableHeaders, wire::lengthDelimitedSize(FieldIdName, header.size()));
+    wire::appendLengthDelimited(&headers_, FieldIdName, header);
+  }
+}
+
+bool TableEncoder::addRow(std::initializer_list<std::string_view> values) {
+  values_.clear();
+  bool valid = true;
+  if (sanitized_values_.size() < values.size()) {
+    sanitized_values_.resize(values.size());
+  }
+  size_t row_size = 0;
+  for (std::string_view value : values) {
+    std::string& sanitized = sanitized_values_[values_.size()];
+    if (sanitizeUtf8(value, &sanitized)) {
+      values_.push_back(value);
+    } else {
+      values_.push_back(sanitized);
+      valid = false;
+    }
+    row_size += wire::lengthDelimitedSize(RowValues, valueSize(values_.back()));
+  }
+
+  wire::appendLengthDelimitedHeader(&rows_, TableRows, row_size);
+  for (std::string_view value : values_) {
+    wire::appendLengthDelimitedHeader(&rows_, RowValues, valueSize(value));
+    wire::appendLengthDelimited(&rows_, ValueStringValue, value);
+  }
+  row_count_++;
+  return valid;
+}
+
+HybridInspectRequestEncoder::HybridInspectRequestEncoder(std::string_view job_trigger_name) {
+  wire::appendNonEmpty(&prefix_, HybridRequestName, job_trigger_name);
+}
+
+std::string_view HybridInspectRequestEncoder::encode(const TableEncoder& table) {
+  const size_t content_item_size = wire::lengthDelimitedSize(ContentItemTable, table.size());
+  const size_t hybrid_item_size =
+      wire::lengthDelimitedSize(HybridContentItemItem, content_item_size);
+
+  output_.clear();
+  output_.append(prefix_);
+  wire::appendLengthDelimitedHeader(&output_, HybridRequestHybridItem, hybrid_item_size);
+  wire::appendLengthDelimitedHeader(&output_, HybridContentItemItem, content_item_size);
+  wire::appendLengthDelimitedHeader(&output_, ContentItemTable, table.size());
+  table.appendTo(&output_);
+  return output_;
+}
+
+}}
@@ -0,0 +1,128 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace google { namespace dlp_filter {
+
+class TableEncoder;
+
+// Writes google.privacy.dlp.v2.InspectContentRequest messages directly in
+// protobuf wire format.
+//
+// Requests sent by the filter always have the same shape: constant parent,
+// template and location, and the captured body as a byte item or captured
+// messages as a table. The constant fields are encoded once at construction
+// and every request is written into a single output buffer that is reused
+// between calls, so encoding costs one copy of the body and no allocation
+// once the buffer has grown.
+//
+// Output is byte-for-byte identical to serializing the equivalent message with
+// the generated code.
+class InspectContentRequestEncoder {
+ public:
+  // Empty values are omitted, like unset proto3 fields. With include_quote,
+  // requests carry an inspect_config asking for the quote of every finding,
+  // on top of the template.
+  InspectContentRequestEncoder(
+      std::string_view parent,
+      std::string_view inspect_template_name,
+      std::string_view location_id,
+      bool include_quote);
+
+  // Reserves room for requests carrying up to max_data_size bytes of data.
+  void reserve(size_t max_data_size);
+
+  // Encodes a request inspecting the given data as a byte item.
+  // The returned view stays valid until the next call to encode.
+  std::string_view encode(const char* data, size_t size);
+
+  // Encodes a request inspecting the rows of a table.
+  std::string_view encode(const TableEncoder& table);
+
+ private:
+  // Fields preceding the item: parent, inspect_config.
+  std::string prefix_;
+  // Fields following the item: inspect_template_name, location_id.
+  std::string suffix_;
+  std::string output_;
+};
+
+// Builds a google.privacy.dlp.v2.Table in protobuf wire format, one row of
+// string values at a time.
+//
+// Values are stored as Value.string_value, which has to be valid UTF-8:
+// invalid sequences, e.g. in binary bodies, are replaced by U+FFFD.
+class TableEncoder {
+ public:
+  explicit TableEncoder(const std::vector<std::string>& headers);
+
+  // Adds a row with one value per header. Returns false if invalid UTF-8 was
+  // replaced in a value, which moves the offsets of the bytes after it.
+  bool addRow(std::initializer_list<std::string_view> values);
+
+  // Removes all rows.
+  void clear() {
+    rows_.clear();
+    row_count_ = 0;
+  }
+
+  size_t rowCount() const {
+    return row_count_;
+  }
+
+  // Size of the encoded Table message.
+  size_t size() const {
+    return headers_.size() + rows_.size();
+  }
+
+  // Appends the encoded Table message, without tag and length.
+  void appendTo(std::string* out) const {
+    out->append(headers_);
+    out->append(rows_);
+  }
+
+ private:
+  std::string headers_;
+  std::string rows_;
+  size_t row_count_;
+  // Values of the row being added, after UTF-8 validation
+  std::vector<std::string_view> values_;
+  std::vector<std::string> sanitized_values_;
+};
+
+// Writes google.privacy.dlp.v2.HybridInspectJobTriggerRequest messages
+// sending a table of captured content to a hybrid job trigger, in protobuf
+// wire format.
+class HybridInspectRequestEncoder {
+ public:
+  // Full resource name of the trigger:
+  // projects/<project_id>/locations/<location_id>/jobTriggers/<trigger_id>
+  explicit HybridInspectRequestEncoder(std::string_view job_trigger_name);
+
+  // Encodes a request carrying the table as its item.
+  // The returned view stays valid until the next call to encode.
+  std::string_view encode(const TableEncoder& table);
+
+ private:
+  // Fields preceding the item: name.
+  std::string prefix_;
+  std::string output_;
+};
+
+}}
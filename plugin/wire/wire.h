@@ -0,0 +1,157 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace google { namespace dlp_filter { namespace wire {
+
+// Protobuf wire format primitives
+// (see https://developers.google.com/protocol-buffers/docs/encoding).
+
+enum WireType {
+  Varint = 0,
+  Fixed64 = 1,
+  LengthDelimited = 2,
+  StartGroup = 3,
+  EndGroup = 4,
+  Fixed32 = 5
+};
+
+inline size_t varintSize(uint64_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+inline void appendVarint(std::string* out, uint64_t value) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+inline void appendTag(std::string* out, uint32_t field_number, WireType type) {
+  appendVarint(out, (static_cast<uint64_t>(field_number) << 3) | type);
+}
+
+// Size of a length-delimited field holding payload_size bytes, including its
+// tag and length prefix.
+inline size_t lengthDelimitedSize(uint32_t field_number, size_t payload_size) {
+  return varintSize(static_cast<uint64_t>(field_number) << 3) + varintSize(payload_size)
+      + payload_size;
+}
+
+inline void appendLengthDelimitedHeader(std::string* out, uint32_t field_number,
+                                        size_t payload_size) {
+  appendTag(out, field_number, LengthDelimited);
+  appendVarint(out, payload_size);
+}
+
+inline void appendLengthDelimited(std::string* out, uint32_t field_number,
+                                  std::string_view payload) {
+  appendLengthDelimitedHeader(out, field_number, payload.size());
+  out->append(payload.data(), payload.size());
+}
+
+// Appends a proto3 string/bytes field, which is omitted when empty.
+inline void appendNonEmpty(std::string* out, uint32_t field_number, std::string_view payload) {
+  if (!payload.empty()) {
+    appendLengthDelimited(out, field_number, payload);
+  }
+}
+
+// Sequential reader over a serialized message. Every read returns false on
+// truncated or invalid input and leaves the reader in an unspecified position.
+class Reader {
+ public:
+  Reader(const char* begin, const char* end) : pos_(begin), end_(end) {}
+  explicit Reader(std::string_view data) : Reader(data.data(), data.data() + data.size()) {}
+
+  bool done() const {
+    return pos_ >= end_;
+  }
+
+  bool readVarint(uint64_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && pos_ < end_; shift += 7) {
+      const uint8_t byte = static_cast<uint8_t>(*pos_++);
+      result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if (byte < 0x80) {
+        *value = result;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool readTag(uint32_t* field_number, WireType* type) {
+    uint64_t key;
+    if (!readVarint(&key) || (key >> 3) == 0 || (key >> 3) > UINT32_MAX) {
+      return false;
+    }
+    *field_number = static_cast<uint32_t>(key >> 3);
+    *type = static_cast<WireType>(key & 0x7);
+    return true;
+  }
+
+  bool readLengthDelimited(std::string_view* value) {
+    uint64_t size;
+    if (!readVarint(&size) || size > static_cast<uint64_t>(end_ - pos_)) {
+      return false;
+    }
+    *value = std::string_view(pos_, size);
+    pos_ += size;
+    return true;
+  }
+
+  // Skips the value of a field of the given type. Groups are not supported,
+  // they do not occur in proto3 messages.
+  bool skip(WireType type) {
+    uint64_t varint;
+    std::string_view bytes;
+    switch (type) {
+      case Varint:
+        return readVarint(&varint);
+      case Fixed64:
+        return skipBytes(8);
+      case LengthDelimited:
+        return readLengthDelimited(&bytes);
+      case Fixed32:
+        return skipBytes(4);
+      default:
+        return false;
+    }
+  }
+
+ private:
+  bool skipBytes(size_t size) {
+    if (size > static_cast<size_t>(end_ - pos_)) {
+      return false;
+    }
+    pos_ += size;
+    return true;
+  }
+
+  const char* pos_;
+  const char* end_;
+};
+
+}}}
@@ -0,0 +1,20 @@
+#!/bin/bash
+
+# Copyright 2021 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Measures the latency, CPU and memory the filter adds to Envoy. See
+# test/envoye2e/dlp_plugin/load_test.go for the DLP_LOAD_* knobs, e.g.
+#   DLP_LOAD_RPS=500 DLP_LOAD_DLP_ERROR_RATE=0.05 ./run_load_tests.sh
+DLP_LOAD_TEST=1 ISTIO_TEST_VERSION=1.9 go test -v -timeout 30m -run TestDlpFilterLoad ./test/envoye2e/dlp_plugin/
@@ -37,6 +37,7 @@ import (
 
 type DlpMock struct {
   Port       uint16
+  Options    fake_dlp.Options
 
   FakeDlp    *fake_dlp.FakeDlpServiceServer
   GrpcServer *grpc.Server
@@ -44,7 +45,7 @@ type DlpMock struct {
 
 func (d *DlpMock) Run(params *driver.Params) error {
   // Start a fake DLP server
-  fakeDlp, grpcServer := fake_dlp.NewFakeDlp(d.Port, 0)
+  fakeDlp, grpcServer := fake_dlp.NewFakeDlpWithOptions(d.Port, d.Options)
   d.FakeDlp = fakeDlp
   d.GrpcServer = grpcServer
   return nil
@@ -192,4 +193,95 @@ func TestDlpFilter(t *testing.T) {
 			}
 		})
 	}
-}
\ No newline at end of file
+}
+type HybridInspectCheck struct {
+  dlpMock        *DlpMock
+  RowCount       int
+  RequestBody    string
+  JobTriggerName string
+}
+
+// Collects hybrid inspect requests until RowCount captured bodies arrived
+func (d *HybridInspectCheck) Run(params *driver.Params) error {
+  rowsReceived := 0
+  to := time.NewTimer(2 * time.Second)
+  defer to.Stop()
+
+  for rowsReceived < d.RowCount {
+    select {
+    case req := <-d.dlpMock.FakeDlp.HybridInspectReq:
+      if req.Name != d.JobTriggerName {
+        return fmt.Errorf("Received request name %v should be equal to %v", req.Name, d.JobTriggerName)
+      }
+      table := req.GetHybridItem().GetItem().GetTable()
+      if len(table.GetHeaders()) != 3 || table.GetHeaders()[2].GetName() != "content" {
+        return fmt.Errorf("Received unexpected table headers %v", table.GetHeaders())
+      }
+      for _, row := range table.GetRows() {
+        if row.GetValues()[2].GetStringValue() != d.RequestBody {
+          return fmt.Errorf("Received row content %v should be equal to %v", row.GetValues()[2], d.RequestBody)
+        }
+        rowsReceived++
+      }
+    case <-to.C:
+      return fmt.Errorf("timeout: DLP did not receive required rows: %d", rowsReceived)
+    }
+  }
+  return nil
+}
+
+func (d *HybridInspectCheck) Cleanup() {
+}
+
+var _ driver.Step = &HybridInspectCheck{}
+
+// Requests and responses are batched into rows of hybrid inspect calls,
+// whose responses are only acknowledgements.
+func TestDlpFilterHybridInspect(t *testing.T) {
+  const requestBody = "Hi, this is my SSN: 987-65-4321."
+  const jobTriggerName = "projects/test-project/locations/global/jobTriggers/test-trigger"
+  params := driver.NewTestParams(t, map[string]string{
+    "DlpWasmFile":    filepath.Join(env.GetBazelBinOrDie(), "plugin/filter.wasm"),
+    "JobTriggerName": jobTriggerName,
+    "MaxBatchSize":   "4",
+  }, test.ExtensionE2ETests)
+  dlpPort := params.Ports.Max + 1
+  params.Vars["DlpGrpcUrl"] = "localhost:" + strconv.Itoa(int(dlpPort))
+  params.Vars["ServerHTTPFilters"] = params.LoadTestData("test/envoye2e/dlp_plugin/testdata/server_filter_hybrid.yaml.tmpl")
+  dlpMock := &DlpMock{
+    Port: dlpPort,
+  }
+
+  if err := (&driver.Scenario{
+    Steps: []driver.Step{
+      &driver.XDS{},
+      &driver.Update{
+        Node: "server", Version: "0", Listeners: []string{string(testdata.MustAsset("listener/server.yaml.tmpl"))},
+      },
+      &driver.Envoy{
+        Bootstrap:       params.FillTestData(string(testdata.MustAsset("bootstrap/server.yaml.tmpl"))),
+        DownloadVersion: os.Getenv("ISTIO_TEST_VERSION"),
+      },
+      dlpMock,
+      &driver.Sleep{Duration: 1 * time.Second},
+      &driver.Repeat{
+        N: 5,
+        Step: &dlp_driver.HTTPCall{
+          Port:         params.Ports.ServerPort,
+          Method:       "POST",
+          RequestBody:  requestBody,
+          ResponseCode: 200,
+        },
+      },
+      // 10 rows: two full batches, the rest sent after the batch delay
+      &HybridInspectCheck{
+        dlpMock:        dlpMock,
+        RowCount:       10,
+        RequestBody:    requestBody,
+        JobTriggerName: jobTriggerName,
+      },
+    },
+  }).Run(params); err != nil {
+    t.Fatal(err)
+  }
+}
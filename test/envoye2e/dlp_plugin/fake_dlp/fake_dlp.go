@@ -18,21 +18,154 @@ import (
   "context"
   "fmt"
   "log"
+  "math"
+  "math/rand"
   "net"
+  "sync"
+  "sync/atomic"
   "time"
 
   grpc "google.golang.org/grpc"
+  codes "google.golang.org/grpc/codes"
+  status "google.golang.org/grpc/status"
   empty "github.com/golang/protobuf/ptypes/empty"
   dlppb "google.golang.org/genproto/googleapis/privacy/dlp/v2"
 )
 
-// FakeStackdriverMetricServer is a fake stackdriver server which implements all of monitoring v3 service method.
+// LatencyDistribution generates the time the fake server takes to answer a call.
+type LatencyDistribution interface {
+  Sample(r *rand.Rand) time.Duration
+}
+
+// FixedLatency always waits for the same duration.
+type FixedLatency time.Duration
+
+func (l FixedLatency) Sample(*rand.Rand) time.Duration {
+  return time.Duration(l)
+}
+
+// UniformLatency waits for a duration uniformly distributed in [Min, Max).
+type UniformLatency struct {
+  Min time.Duration
+  Max time.Duration
+}
+
+func (l UniformLatency) Sample(r *rand.Rand) time.Duration {
+  if l.Max <= l.Min {
+    return l.Min
+  }
+  return l.Min + time.Duration(r.Int63n(int64(l.Max-l.Min)))
+}
+
+// LogNormalLatency waits for a log-normally distributed duration with the given
+// median, which models the long tail of a remote service. Sigma of 0.5 gives a
+// p99 of about 3.2 times the median.
+type LogNormalLatency struct {
+  Median time.Duration
+  Sigma  float64
+}
+
+func (l LogNormalLatency) Sample(r *rand.Rand) time.Duration {
+  return time.Duration(float64(l.Median) * math.Exp(l.Sigma*r.NormFloat64()))
+}
+
+// Options control how the fake server answers calls.
+type Options struct {
+  // Latency of every InspectContent and HybridInspectJobTrigger call, none if nil.
+  Latency LatencyDistribution
+  // Fraction of calls, in [0, 1], answered with ErrorCode instead of a response.
+  ErrorRate float64
+  // Status returned for injected errors, RESOURCE_EXHAUSTED if unset.
+  ErrorCode codes.Code
+  // Fraction of successful InspectContent calls, in [0, 1], answered with
+  // FindingsPerResponse findings in the inspected data.
+  FindingRate float64
+  // Number of findings of the responses carrying findings, 3 if unset.
+  FindingsPerResponse int
+}
+
+// Counters of calls received by the fake server, safe for concurrent use.
+type Counters struct {
+  InspectContent uint64
+  HybridInspect  uint64
+  Errors         uint64
+  BytesReceived  uint64
+  // Responses carrying findings
+  Findings       uint64
+}
+
+// FakeDlpServiceServer is a fake DLP server which implements all of DLP v2 service methods.
+//
+// Received InspectContent and HybridInspectJobTrigger requests are published
+// on the channels for verification; once a channel is full further requests
+// are only counted, so that the server can be used under sustained load.
 type FakeDlpServiceServer struct {
-  delay               time.Duration
+  options             Options
+  counters            Counters
+  randMu              sync.Mutex
+  rand                *rand.Rand
   InspectContentReq   chan *dlppb.InspectContentRequest
   HybridInspectReq    chan *dlppb.HybridInspectJobTriggerRequest
 }
 
+// Counters returns a snapshot of the call counters.
+func (server *FakeDlpServiceServer) Counters() Counters {
+  return Counters{
+    InspectContent: atomic.LoadUint64(&server.counters.InspectContent),
+    HybridInspect:  atomic.LoadUint64(&server.counters.HybridInspect),
+    Errors:         atomic.LoadUint64(&server.counters.Errors),
+    BytesReceived:  atomic.LoadUint64(&server.counters.BytesReceived),
+    Findings:       atomic.LoadUint64(&server.counters.Findings),
+  }
+}
+
+// respond waits for the configured latency and returns an injected error, if
+// any, and whether a successful response should carry findings.
+func (server *FakeDlpServiceServer) respond() (bool, error) {
+  server.randMu.Lock()
+  var latency time.Duration
+  if server.options.Latency != nil {
+    latency = server.options.Latency.Sample(server.rand)
+  }
+  inject := server.options.ErrorRate > 0 && server.rand.Float64() < server.options.ErrorRate
+  findings := server.options.FindingRate > 0 && server.rand.Float64() < server.options.FindingRate
+  server.randMu.Unlock()
+
+  time.Sleep(latency)
+  if inject {
+    atomic.AddUint64(&server.counters.Errors, 1)
+    code := server.options.ErrorCode
+    if code == codes.OK {
+      code = codes.ResourceExhausted
+    }
+    return false, status.Error(code, "injected by fake DLP server")
+  }
+  return findings, nil
+}
+
+// findings returns findings spread over the inspected data, with their quotes,
+// as Cloud DLP reports them.
+func (server *FakeDlpServiceServer) findings(data []byte) []*dlppb.Finding {
+  count := server.options.FindingsPerResponse
+  if count <= 0 {
+    count = 3
+  }
+  const size = 11
+  var findings []*dlppb.Finding
+  for i := 0; i < count && len(data) >= size; i++ {
+    start := int64(len(data)-size) * int64(i) / int64(count)
+    findings = append(findings, &dlppb.Finding{
+      Quote:      string(data[start : start+size]),
+      InfoType:   &dlppb.InfoType{Name: "US_SOCIAL_SECURITY_NUMBER"},
+      Likelihood: dlppb.Likelihood_LIKELY,
+      Location: &dlppb.Location{
+        ByteRange: &dlppb.Range{Start: start, End: start + size},
+      },
+    })
+  }
+  return findings
+}
+
 // Implementations of all DLP API methods
 func (*FakeDlpServiceServer) ActivateJobTrigger(context.Context, *dlppb.ActivateJobTriggerRequest) (*dlppb.DlpJob, error) {
   return &dlppb.DlpJob{}, nil
@@ -95,14 +228,34 @@ func (*FakeDlpServiceServer) HybridInspectDlpJob(context.Context, *dlppb.HybridI
   return &dlppb.HybridInspectResponse{}, nil
 }
 func (server *FakeDlpServiceServer) HybridInspectJobTrigger(_ context.Context, req *dlppb.HybridInspectJobTriggerRequest) (*dlppb.HybridInspectResponse, error) {
-  server.HybridInspectReq <- req
-  time.Sleep(server.delay)
+  atomic.AddUint64(&server.counters.HybridInspect, 1)
+  select {
+  case server.HybridInspectReq <- req:
+  default:
+  }
+  if _, err := server.respond(); err != nil {
+    return nil, err
+  }
   return &dlppb.HybridInspectResponse{}, nil
 }
 func (server *FakeDlpServiceServer) InspectContent(_ context.Context, req *dlppb.InspectContentRequest) (*dlppb.InspectContentResponse, error) {
-  server.InspectContentReq <- req
-  time.Sleep(server.delay)
-  return &dlppb.InspectContentResponse{}, nil
+  atomic.AddUint64(&server.counters.InspectContent, 1)
+  atomic.AddUint64(&server.counters.BytesReceived, uint64(len(req.GetItem().GetByteItem().GetData())))
+  select {
+  case server.InspectContentReq <- req:
+  default:
+  }
+  findings, err := server.respond()
+  if err != nil {
+    return nil, err
+  }
+  if !findings {
+    return &dlppb.InspectContentResponse{}, nil
+  }
+  atomic.AddUint64(&server.counters.Findings, 1)
+  return &dlppb.InspectContentResponse{
+    Result: &dlppb.InspectResult{Findings: server.findings(req.GetItem().GetByteItem().GetData())},
+  }, nil
 }
 func (*FakeDlpServiceServer) ListDeidentifyTemplates(context.Context, *dlppb.ListDeidentifyTemplatesRequest) (*dlppb.ListDeidentifyTemplatesResponse, error) {
   return &dlppb.ListDeidentifyTemplatesResponse{}, nil
@@ -141,12 +294,18 @@ func (*FakeDlpServiceServer) UpdateStoredInfoType(context.Context, *dlppb.Update
   return &dlppb.StoredInfoType{}, nil
 }
 
-// NewFakeDlp creates a new fake Dlp server.
+// NewFakeDlp creates a new fake Dlp server answering every call after a fixed delay.
 func NewFakeDlp(port uint16, delay time.Duration) (*FakeDlpServiceServer, *grpc.Server) {
+  return NewFakeDlpWithOptions(port, Options{Latency: FixedLatency(delay)})
+}
+
+// NewFakeDlpWithOptions creates a new fake Dlp server with configurable latency and errors.
+func NewFakeDlpWithOptions(port uint16, options Options) (*FakeDlpServiceServer, *grpc.Server) {
   log.Printf("Dlp server listening on port %v\n", port)
   grpcServer := grpc.NewServer()
   fakeDlp := &FakeDlpServiceServer{
-    delay:               delay,
+    options:             options,
+    rand:                rand.New(rand.NewSource(1)),
     InspectContentReq:   make(chan *dlppb.InspectContentRequest, 100),
     HybridInspectReq:    make(chan *dlppb.HybridInspectJobTriggerRequest, 100),
   }
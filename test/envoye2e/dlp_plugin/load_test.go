@@ -0,0 +1,464 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package dlp_plugin
+
+// Load test measuring the overhead the filter adds to the proxy.
+//
+// The same open-loop load is sent through Envoy once without the filter and
+// once with it, with the fake DLP server standing in for Cloud DLP. The test
+// reports the latency the filter adds at p50/p99 and the CPU and memory used
+// by the Envoy process, so that regressions in the filter hot path show up
+// before rollout. Everything runs locally.
+//
+// The test is skipped unless DLP_LOAD_TEST is set (see run_load_tests.sh).
+// It is configured through environment variables:
+//
+//   DLP_LOAD_RPS             requests per second (default 200)
+//   DLP_LOAD_DURATION        duration of each run (default 30s)
+//   DLP_LOAD_BODY_SIZES      body size distribution as size:weight pairs
+//                            (default "1024:70,16384:25,262144:5")
+//   DLP_LOAD_SAMPLING        percentage of bodies sent to DLP (default 100)
+//   DLP_LOAD_DLP_LATENCY     fake DLP latency: "fixed:<d>", "uniform:<min>:<max>"
+//                            or "lognormal:<median>:<sigma>" (default "lognormal:50ms:0.5")
+//   DLP_LOAD_DLP_ERROR_RATE  fraction of DLP calls failing (default 0)
+//   DLP_LOAD_DLP_ERROR_CODE  gRPC code of failing calls (default RESOURCE_EXHAUSTED)
+//   DLP_LOAD_DLP_FINDING_RATE
+//                            fraction of DLP calls returning findings (default 0.1)
+//   DLP_LOAD_RUNTIME         runtime running the filter: "v8" (default) runs
+//                            filter.wasm, "null" runs the native build and needs
+//                            an Envoy binary linking it (see docs/native_build.md)
+//   DLP_LOAD_WASM_FILE       module loaded by the v8 runtime, relative to
+//                            bazel-bin (default "plugin/filter.wasm")
+
+import (
+	"encoding/json"
+	"fmt"
+	"io/ioutil"
+	"math/rand"
+	"net/http"
+	"os"
+	"path/filepath"
+	"sort"
+	"strconv"
+	"strings"
+	"sync"
+	"testing"
+	"time"
+
+	"istio.io/proxy/test/envoye2e/driver"
+	"istio.io/proxy/test/envoye2e/env"
+	"istio.io/proxy/testdata"
+
+	codes "google.golang.org/grpc/codes"
+
+	test "github.com/GoogleCloudPlatform/dlp-filter-for-envoy/test/envoye2e"
+	fake_dlp "github.com/GoogleCloudPlatform/dlp-filter-for-envoy/test/envoye2e/dlp_plugin/fake_dlp"
+)
+
+// Linux reports process CPU time in ticks of USER_HZ, which is 100 on all
+// supported architectures.
+const clockTicksPerSecond = 100
+
+type weightedSize struct {
+	size   int
+	weight int
+}
+
+type loadConfig struct {
+	rps            int
+	duration       time.Duration
+	bodySizes      []weightedSize
+	sampling       int
+	dlpLatency     fake_dlp.LatencyDistribution
+	dlpErrorRate   float64
+	dlpErrorCode   codes.Code
+	dlpFindingRate float64
+	runtime        string
+	wasmFile       string
+}
+
+func envOrDefault(name, def string) string {
+	if value := os.Getenv(name); value != "" {
+		return value
+	}
+	return def
+}
+
+func parseLoadConfig() (*loadConfig, error) {
+	config := &loadConfig{}
+	var err error
+	if config.rps, err = strconv.Atoi(envOrDefault("DLP_LOAD_RPS", "200")); err != nil || config.rps <= 0 {
+		return nil, fmt.Errorf("invalid DLP_LOAD_RPS: %v", err)
+	}
+	if config.duration, err = time.ParseDuration(envOrDefault("DLP_LOAD_DURATION", "30s")); err != nil {
+		return nil, fmt.Errorf("invalid DLP_LOAD_DURATION: %v", err)
+	}
+	if config.bodySizes, err = parseBodySizes(envOrDefault("DLP_LOAD_BODY_SIZES", "1024:70,16384:25,262144:5")); err != nil {
+		return nil, err
+	}
+	if config.sampling, err = strconv.Atoi(envOrDefault("DLP_LOAD_SAMPLING", "100")); err != nil || config.sampling < 0 || config.sampling > 100 {
+		return nil, fmt.Errorf("invalid DLP_LOAD_SAMPLING: %v", err)
+	}
+	if config.dlpLatency, err = parseLatency(envOrDefault("DLP_LOAD_DLP_LATENCY", "lognormal:50ms:0.5")); err != nil {
+		return nil, err
+	}
+	if config.dlpErrorRate, err = strconv.ParseFloat(envOrDefault("DLP_LOAD_DLP_ERROR_RATE", "0"), 64); err != nil {
+		return nil, fmt.Errorf("invalid DLP_LOAD_DLP_ERROR_RATE: %v", err)
+	}
+	code := envOrDefault("DLP_LOAD_DLP_ERROR_CODE", "RESOURCE_EXHAUSTED")
+	if err = config.dlpErrorCode.UnmarshalJSON([]byte(strconv.Quote(code))); err != nil {
+		return nil, fmt.Errorf("invalid DLP_LOAD_DLP_ERROR_CODE: %v", err)
+	}
+	if config.dlpFindingRate, err = strconv.ParseFloat(envOrDefault("DLP_LOAD_DLP_FINDING_RATE", "0.1"), 64); err != nil {
+		return nil, fmt.Errorf("invalid DLP_LOAD_DLP_FINDING_RATE: %v", err)
+	}
+	config.runtime = envOrDefault("DLP_LOAD_RUNTIME", "v8")
+	if config.runtime != "v8" && config.runtime != "null" {
+		return nil, fmt.Errorf("invalid DLP_LOAD_RUNTIME %q", config.runtime)
+	}
+	config.wasmFile = envOrDefault("DLP_LOAD_WASM_FILE", "plugin/filter.wasm")
+	return config, nil
+}
+
+func parseBodySizes(spec string) ([]weightedSize, error) {
+	var sizes []weightedSize
+	for _, pair := range strings.Split(spec, ",") {
+		parts := strings.Split(pair, ":")
+		if len(parts) != 2 {
+			return nil, fmt.Errorf("invalid body size %q, expected size:weight", pair)
+		}
+		size, err := strconv.Atoi(parts[0])
+		if err != nil || size < 0 {
+			return nil, fmt.Errorf("invalid body size %q", pair)
+		}
+		weight, err := strconv.Atoi(parts[1])
+		if err != nil || weight <= 0 {
+			return nil, fmt.Errorf("invalid body size weight %q", pair)
+		}
+		sizes = append(sizes, weightedSize{size: size, weight: weight})
+	}
+	return sizes, nil
+}
+
+func parseLatency(spec string) (fake_dlp.LatencyDistribution, error) {
+	parts := strings.Split(spec, ":")
+	invalid := fmt.Errorf("invalid DLP_LOAD_DLP_LATENCY %q", spec)
+	switch {
+	case parts[0] == "fixed" && len(parts) == 2:
+		d, err := time.ParseDuration(parts[1])
+		if err != nil {
+			return nil, invalid
+		}
+		return fake_dlp.FixedLatency(d), nil
+	case parts[0] == "uniform" && len(parts) == 3:
+		min, err1 := time.ParseDuration(parts[1])
+		max, err2 := time.ParseDuration(parts[2])
+		if err1 != nil || err2 != nil {
+			return nil, invalid
+		}
+		return fake_dlp.UniformLatency{Min: min, Max: max}, nil
+	case parts[0] == "lognormal" && len(parts) == 3:
+		median, err1 := time.ParseDuration(parts[1])
+		sigma, err2 := strconv.ParseFloat(parts[2], 64)
+		if err1 != nil || err2 != nil {
+			return nil, invalid
+		}
+		return fake_dlp.LogNormalLatency{Median: median, Sigma: sigma}, nil
+	}
+	return nil, invalid
+}
+
+// loadResult holds what was measured during a single run.
+type loadResult struct {
+	latencies []time.Duration
+	errors    int
+	cpu       time.Duration
+	rssBytes  uint64
+	heapBytes uint64
+	dlp       fake_dlp.Counters
+}
+
+func (r *loadResult) percentile(p float64) time.Duration {
+	if len(r.latencies) == 0 {
+		return 0
+	}
+	return r.latencies[int(p*float64(len(r.latencies)-1))]
+}
+
+// LoadGenerator sends POST requests with bodies drawn from a size distribution
+// at a constant rate, independently of how fast responses come back.
+type LoadGenerator struct {
+	Port      uint16
+	RPS       int
+	Duration  time.Duration
+	BodySizes []weightedSize
+	Result    *loadResult
+}
+
+func (g *LoadGenerator) Run(_ *driver.Params) error {
+	totalWeight := 0
+	bodies := make([]string, len(g.BodySizes))
+	for i, size := range g.BodySizes {
+		totalWeight += size.weight
+		bodies[i] = strings.Repeat("Hi, this is my SSN: 987-65-4321.", size.size/32+1)[:size.size]
+	}
+	r := rand.New(rand.NewSource(1))
+	pickBody := func() string {
+		n := r.Intn(totalWeight)
+		for i, size := range g.BodySizes {
+			if n < size.weight {
+				return bodies[i]
+			}
+			n -= size.weight
+		}
+		return bodies[len(bodies)-1]
+	}
+
+	url := fmt.Sprintf("http://127.0.0.1:%d/", g.Port)
+	client := &http.Client{
+		Timeout:   10 * time.Second,
+		Transport: &http.Transport{MaxIdleConnsPerHost: g.RPS},
+	}
+	var mu sync.Mutex
+	var wg sync.WaitGroup
+	ticker := time.NewTicker(time.Second / time.Duration(g.RPS))
+	defer ticker.Stop()
+	deadline := time.Now().Add(g.Duration)
+	for now := range ticker.C {
+		if now.After(deadline) {
+			break
+		}
+		body := pickBody()
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			start := time.Now()
+			resp, err := client.Post(url, "text/plain", strings.NewReader(body))
+			ok := err == nil && resp.StatusCode == http.StatusOK
+			if err == nil {
+				ioutil.ReadAll(resp.Body)
+				resp.Body.Close()
+			}
+			latency := time.Since(start)
+			mu.Lock()
+			defer mu.Unlock()
+			if ok {
+				g.Result.latencies = append(g.Result.latencies, latency)
+			} else {
+				g.Result.errors++
+			}
+		}()
+	}
+	wg.Wait()
+	sort.Slice(g.Result.latencies, func(i, j int) bool {
+		return g.Result.latencies[i] < g.Result.latencies[j]
+	})
+	return nil
+}
+
+func (g *LoadGenerator) Cleanup() {}
+
+var _ driver.Step = &LoadGenerator{}
+
+// EnvoyUsage samples CPU time and memory of the Envoy process started by the
+// test. CPU is accumulated as the difference between a Start and a stop sample.
+type EnvoyUsage struct {
+	AdminPort uint16
+	Start     bool
+	Result    *loadResult
+}
+
+func (u *EnvoyUsage) Run(_ *driver.Params) error {
+	pid, err := findEnvoyPid()
+	if err != nil {
+		return err
+	}
+	cpu, rss, err := readProcessUsage(pid)
+	if err != nil {
+		return err
+	}
+	if u.Start {
+		u.Result.cpu = -cpu
+		return nil
+	}
+	u.Result.cpu += cpu
+	u.Result.rssBytes = rss
+	u.Result.heapBytes, err = readEnvoyHeap(u.AdminPort)
+	return err
+}
+
+func (u *EnvoyUsage) Cleanup() {}
+
+var _ driver.Step = &EnvoyUsage{}
+
+// findEnvoyPid returns the envoy process started by this test binary.
+func findEnvoyPid() (int, error) {
+	stats, _ := filepath.Glob("/proc/[0-9]*/stat")
+	for _, stat := range stats {
+		fields, err := readStat(stat)
+		if err != nil {
+			continue
+		}
+		if fields[1] == "(envoy)" && fields[3] == strconv.Itoa(os.Getpid()) {
+			return strconv.Atoi(fields[0])
+		}
+	}
+	return 0, fmt.Errorf("envoy process not found")
+}
+
+func readStat(path string) ([]string, error) {
+	content, err := ioutil.ReadFile(path)
+	if err != nil {
+		return nil, err
+	}
+	fields := strings.Fields(string(content))
+	if len(fields) < 24 {
+		return nil, fmt.Errorf("unexpected format of %s", path)
+	}
+	return fields, nil
+}
+
+// readProcessUsage returns user+system CPU time and resident memory of a process.
+func readProcessUsage(pid int) (time.Duration, uint64, error) {
+	fields, err := readStat(fmt.Sprintf("/proc/%d/stat", pid))
+	if err != nil {
+		return 0, 0, err
+	}
+	utime, _ := strconv.ParseUint(fields[13], 10, 64)
+	stime, _ := strconv.ParseUint(fields[14], 10, 64)
+	rssPages, _ := strconv.ParseUint(fields[23], 10, 64)
+	cpu := time.Duration(utime+stime) * time.Second / clockTicksPerSecond
+	return cpu, rssPages * uint64(os.Getpagesize()), nil
+}
+
+// readEnvoyHeap returns the heap allocated by Envoy, including Wasm VMs,
+// as reported by the admin /memory endpoint.
+func readEnvoyHeap(adminPort uint16) (uint64, error) {
+	resp, err := http.Get(fmt.Sprintf("http://127.0.0.1:%d/memory", adminPort))
+	if err != nil {
+		return 0, err
+	}
+	defer resp.Body.Close()
+	var memory struct {
+		Allocated string `json:"allocated"`
+	}
+	if err := json.NewDecoder(resp.Body).Decode(&memory); err != nil {
+		return 0, err
+	}
+	return strconv.ParseUint(memory.Allocated, 10, 64)
+}
+
+func runLoad(t *testing.T, config *loadConfig, withFilter bool) *loadResult {
+	result := &loadResult{}
+	params := driver.NewTestParams(t, map[string]string{
+		"DlpWasmFile":     filepath.Join(env.GetBazelBinOrDie(), config.wasmFile),
+		"DlpRuntime":      config.runtime,
+		"Project":         "test-project",
+		"SamplingPercent": strconv.Itoa(config.sampling),
+		"MaxRequestSize":  "1048576",
+	}, test.ExtensionE2ETests)
+	dlpPort := params.Ports.Max + 1
+	params.Vars["DlpGrpcUrl"] = "localhost:" + strconv.Itoa(int(dlpPort))
+	if withFilter {
+		params.Vars["ServerHTTPFilters"] = params.LoadTestData("test/envoye2e/dlp_plugin/testdata/server_filter_load.yaml.tmpl")
+	}
+	dlpMock := &DlpMock{
+		Port: dlpPort,
+		Options: fake_dlp.Options{
+			Latency:     config.dlpLatency,
+			ErrorRate:   config.dlpErrorRate,
+			ErrorCode:   config.dlpErrorCode,
+			FindingRate: config.dlpFindingRate,
+		},
+	}
+
+	if err := (&driver.Scenario{
+		Steps: []driver.Step{
+			&driver.XDS{},
+			&driver.Update{
+				Node: "server", Version: "0", Listeners: []string{string(testdata.MustAsset("listener/server.yaml.tmpl"))},
+			},
+			&driver.Envoy{
+				Bootstrap:       params.FillTestData(string(testdata.MustAsset("bootstrap/server.yaml.tmpl"))),
+				DownloadVersion: os.Getenv("ISTIO_TEST_VERSION"),
+			},
+			dlpMock,
+			&driver.Sleep{Duration: 1 * time.Second},
+			&EnvoyUsage{AdminPort: params.Ports.ServerAdmin, Start: true, Result: result},
+			&LoadGenerator{
+				Port:      params.Ports.ServerPort,
+				RPS:       config.rps,
+				Duration:  config.duration,
+				BodySizes: config.bodySizes,
+				Result:    result,
+			},
+			&EnvoyUsage{AdminPort: params.Ports.ServerAdmin, Result: result},
+		},
+	}).Run(params); err != nil {
+		t.Fatal(err)
+	}
+	result.dlp = dlpMock.FakeDlp.Counters()
+	return result
+}
+
+func TestDlpFilterLoad(t *testing.T) {
+	if os.Getenv("DLP_LOAD_TEST") == "" {
+		t.Skip("set DLP_LOAD_TEST=1 to run the load test")
+	}
+	config, err := parseLoadConfig()
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	var baseline, filter *loadResult
+	t.Run("NoFilter", func(t *testing.T) {
+		baseline = runLoad(t, config, false)
+	})
+	t.Run("Filter", func(t *testing.T) {
+		filter = runLoad(t, config, true)
+	})
+	if baseline == nil || filter == nil {
+		return
+	}
+
+	perRequest := func(r *loadResult) time.Duration {
+		if len(r.latencies) == 0 {
+			return 0
+		}
+		return r.cpu / time.Duration(len(r.latencies))
+	}
+	t.Logf("load: %d rps for %v, sampling %d%%, fake DLP error rate %v, finding rate %v, runtime %s",
+		config.rps, config.duration, config.sampling, config.dlpErrorRate, config.dlpFindingRate,
+		config.runtime)
+	t.Logf("%-10s %10s %10s %10s %14s %12s %12s", "", "requests", "p50", "p99", "cpu/request", "rss MiB", "heap MiB")
+	for _, row := range []struct {
+		name   string
+		result *loadResult
+	}{{"no filter", baseline}, {"filter", filter}} {
+		t.Logf("%-10s %10d %10v %10v %14v %12.1f %12.1f", row.name, len(row.result.latencies),
+			row.result.percentile(0.5), row.result.percentile(0.99), perRequest(row.result),
+			float64(row.result.rssBytes)/(1<<20), float64(row.result.heapBytes)/(1<<20))
+	}
+	t.Logf("added by filter: p50 %v, p99 %v, cpu/request %v, heap %.1f MiB",
+		filter.percentile(0.5)-baseline.percentile(0.5),
+		filter.percentile(0.99)-baseline.percentile(0.99),
+		perRequest(filter)-perRequest(baseline),
+		(float64(filter.heapBytes)-float64(baseline.heapBytes))/(1<<20))
+	t.Logf("fake DLP: %d InspectContent calls, %d bytes, %d injected errors, %d with findings",
+		filter.dlp.InspectContent, filter.dlp.BytesReceived, filter.dlp.Errors, filter.dlp.Findings)
+	if baseline.errors > 0 || filter.errors > 0 {
+		t.Errorf("failed requests: %d without filter, %d with filter", baseline.errors, filter.errors)
+	}
+}
@@ -24,6 +24,8 @@ func init() {
 	ExtensionE2ETests = &env.TestInventory{
 		Tests: []string{
 			"TestDlpFilter/Success",
+			"TestDlpFilterLoad/NoFilter",
+			"TestDlpFilterLoad/Filter",
 		},
 	}
 }
\ No newline at end of file
@@ -0,0 +1,121 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include "gtest/gtest.h"
+#include "plugin/capture/capture_rules.h"
+
+using google::dlp_filter::CaptureRules;
+using google::dlp_filter::MessageProperties;
+using google::dlp_filter::globMatch;
+
+namespace {
+MessageProperties request(std::string_view method, std::string_view path) {
+  return {false, method, path, "api.example.com:8080", "application/json", 0,
+          MessageProperties::UnknownSize};
+}
+
+MessageProperties response(uint32_t status, std::string_view content_type, uint64_t size) {
+  return {true, "GET", "/v1/users", "api.example.com", content_type, status, size};
+}
+}
+
+TEST(GlobMatch, MatchesWildcards) {
+  EXPECT_TRUE(globMatch("/v1/*/users", "/v1/abc/users"));
+  EXPECT_TRUE(globMatch("/v1/*", "/v1/"));
+  EXPECT_TRUE(globMatch("*.json", "/a/b.c.json"));
+  EXPECT_TRUE(globMatch("/v?/x", "/v2/x"));
+  EXPECT_FALSE(globMatch("/v1/*/users", "/v1/abc/groups"));
+  EXPECT_FALSE(globMatch("/v?/x", "/v10/x"));
+  EXPECT_FALSE(globMatch("", "/"));
+}
+
+TEST(CaptureRules, CapturesWithoutMatchingRule) {
+  CaptureRules rules;
+  const CaptureRules::Match match = rules.match(request("POST", "/"));
+  EXPECT_EQ(CaptureRules::NoRule, match.rule);
+  EXPECT_TRUE(match.capture);
+}
+
+TEST(CaptureRules, FirstMatchingRuleDecides) {
+  CaptureRules rules;
+  std::string error;
+  CaptureRules::Rule skip_images;
+  skip_images.action = CaptureRules::Action::Skip;
+  skip_images.content_types = {"Image/", "video/"};
+  ASSERT_TRUE(rules.add(skip_images, &error));
+  CaptureRules::Rule capture_users;
+  capture_users.path_prefixes = {"/v1/users"};
+  ASSERT_TRUE(rules.add(capture_users, &error));
+  CaptureRules::Rule skip_rest;
+  skip_rest.action = CaptureRules::Action::Skip;
+  ASSERT_TRUE(rules.add(skip_rest, &error));
+
+  CaptureRules::Match match = rules.match(response(200, "image/png", 10));
+  EXPECT_EQ(0, match.rule);
+  EXPECT_FALSE(match.capture);
+  match = rules.match(response(200, "application/json", 10));
+  EXPECT_EQ(1, match.rule);
+  EXPECT_TRUE(match.capture);
+  match = rules.match(request("POST", "/v2/orders"));
+  EXPECT_EQ(2, match.rule);
+  EXPECT_FALSE(match.capture);
+}
+
+TEST(CaptureRules, MatchesMethodsHostsAndDirections) {
+  CaptureRules rules;
+  std::string error;
+  CaptureRules::Rule rule;
+  rule.directions = CaptureRules::Request;
+  rule.methods = {"POST", "PUT"};
+  rule.hosts = {"*.EXAMPLE.com"};
+  rule.path_patterns = {"/v1/*"};
+  ASSERT_TRUE(rules.add(rule, &error));
+
+  EXPECT_EQ(0, rules.match(request("PUT", "/v1/x")).rule);
+  EXPECT_EQ(CaptureRules::NoRule, rules.match(request("GET", "/v1/x")).rule);
+  EXPECT_EQ(CaptureRules::NoRule, rules.match(request("PUT", "/v2/x")).rule);
+  EXPECT_EQ(CaptureRules::NoRule, rules.match(response(200, "text/plain", 1)).rule);
+  MessageProperties other_host = request("PUT", "/v1/x");
+  other_host.host = "example.org";
+  EXPECT_EQ(CaptureRules::NoRule, rules.match(other_host).rule);
+
+  rule.methods = {"FETCH"};
+  EXPECT_FALSE(rules.add(rule, &error));
+  EXPECT_EQ("Unknown method: FETCH", error);
+}
+
+TEST(CaptureRules, MatchesStatusAndBodySize) {
+  CaptureRules rules;
+  std::string error;
+  CaptureRules::Rule errors;
+  errors.action = CaptureRules::Action::Skip;
+  errors.min_status = 300;
+  ASSERT_TRUE(rules.add(errors, &error));
+  CaptureRules::Rule large;
+  large.action = CaptureRules::Action::Skip;
+  large.min_body_bytes = 1000;
+  ASSERT_TRUE(rules.add(large, &error));
+
+  EXPECT_EQ(0, rules.match(response(304, "text/html", 0)).rule);
+  EXPECT_EQ(1, rules.match(response(200, "text/html", 1000)).rule);
+  EXPECT_EQ(CaptureRules::NoRule, rules.match(response(200, "text/html", 999)).rule);
+
+  // Without content-length the decision waits for the body.
+  const CaptureRules::Match match =
+      rules.match(response(200, "text/html", MessageProperties::UnknownSize));
+  EXPECT_EQ(1, match.rule);
+  EXPECT_TRUE(match.capture);
+  EXPECT_TRUE(match.needs_body_size);
+}
@@ -0,0 +1,316 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include "gtest/gtest.h"
+#include "plugin/config/config_parser.h"
+#include "plugin/config/json.h"
+
+using google::dlp_filter::JsonValue;
+using google::dlp_filter::parseJson;
+using google::dlp_filter::parsePluginConfig;
+
+TEST(ParseJson, ReadsNestedDocument) {
+  JsonValue value;
+  std::string error;
+  EXPECT_TRUE(parseJson(R"({"a": [1, "xé\n", true, null,], "b": {},})", &value, &error))
+      << error;
+  ASSERT_EQ(JsonValue::Object, value.type());
+  ASSERT_EQ(2, value.objectValue().size());
+  const JsonValue& array = value.objectValue()[0].second;
+  ASSERT_EQ(JsonValue::Array, array.type());
+  ASSERT_EQ(4, array.arrayValue().size());
+  EXPECT_EQ("1", array.arrayValue()[0].stringValue());
+  EXPECT_EQ("x\xc3\xa9\n", array.arrayValue()[1].stringValue());
+  EXPECT_TRUE(array.arrayValue()[2].boolValue());
+  EXPECT_EQ(JsonValue::Null, array.arrayValue()[3].type());
+  EXPECT_EQ(JsonValue::Object, value.objectValue()[1].second.type());
+}
+
+TEST(ParseJson, RejectsMalformedDocument) {
+  JsonValue value;
+  std::string error;
+  EXPECT_FALSE(parseJson(R"({"a": })", &value, &error));
+  EXPECT_FALSE(parseJson(R"({"a": "unterminated})", &value, &error));
+  EXPECT_FALSE(parseJson(R"({"a": 1} trailing)", &value, &error));
+  EXPECT_FALSE(parseJson(R"([1 2])", &value, &error));
+}
+
+TEST(ParsePluginConfig, ReadsFullConfig) {
+  const std::string json = R"(
+{
+  "inspect": {
+    "destination": {
+      "operation": {
+        "store_local": {
+          "project_id": "test-project",
+          "locationId": "us",
+          "inspect_template_name": "test-template",
+        }
+      },
+      "grpc_config": {
+        "target_uri": "localhost:8080",
+        "stat_prefix": "dlp",
+        "channel_credentials": {"google_default": {}}
+      }
+    },
+    "sampling": {
+      "probability": {
+        "numerator": 5,
+        "denominator": "TEN_THOUSAND"
+      }
+    },
+    "max_request_size_bytes": "500000",
+    "stats": {"maxTagValues": 20, "flush_interval_ms": 250, "record_immediately": true}
+  }
+})";
+  ::dlp::PluginConfig config;
+  std::string error;
+  ASSERT_TRUE(parsePluginConfig(json, &config, &error)) << error;
+  const ::dlp::StoreFindingsLocally& store_local =
+      config.inspect().destination().operation().store_local();
+  EXPECT_EQ("test-project", store_local.project_id());
+  EXPECT_EQ("us", store_local.location_id());
+  EXPECT_EQ("test-template", store_local.inspect_template_name());
+  EXPECT_EQ("localhost:8080", config.inspect().destination().grpc_config().target_uri());
+  EXPECT_EQ("dlp", config.inspect().destination().grpc_config().stat_prefix());
+  EXPECT_TRUE(config.inspect().destination().grpc_config().channel_credentials().has_google_default());
+  EXPECT_EQ(5, config.inspect().sampling().probability().numerator());
+  EXPECT_EQ(::dlp::FractionalPercent_DenominatorType_TEN_THOUSAND,
+      config.inspect().sampling().probability().denominator());
+  EXPECT_EQ(500000, config.inspect().max_request_size_bytes());
+  EXPECT_EQ(20, config.inspect().stats().max_tag_values());
+  EXPECT_EQ(250, config.inspect().stats().flush_interval_ms());
+  EXPECT_TRUE(config.inspect().stats().record_immediately());
+}
+
+TEST(ParsePluginConfig, RejectsUnknownField) {
+  ::dlp::PluginConfig config;
+  std::string error;
+  EXPECT_FALSE(parsePluginConfig(R"({"inspect": {"unknown": 1}})", &config, &error));
+  EXPECT_NE(std::string::npos, error.find("unknown"));
+}
+
+TEST(ParsePluginConfig, RejectsUnsupportedGrpcConfig) {
+  ::dlp::PluginConfig config;
+  std::string error;
+  EXPECT_FALSE(parsePluginConfig(
+      R"({"inspect": {"destination": {"grpc_config": {"call_credentials": []}}}})",
+      &config, &error));
+}
+
+TEST(ParsePluginConfig, RejectsWrongTypes) {
+  ::dlp::PluginConfig config;
+  std::string error;
+  EXPECT_FALSE(parsePluginConfig(R"({"inspect": {"max_request_size_bytes": -1}})", &config, &error));
+  EXPECT_FALSE(parsePluginConfig(
+      R"({"inspect": {"sampling": {"probability": {"denominator": "THOUSAND"}}}})",
+      &config, &error));
+  EXPECT_FALSE(parsePluginConfig(R"({"inspect": []})", &config, &error));
+  EXPECT_FALSE(parsePluginConfig(
+      R"({"inspect": {"stats": {"record_immediately": "yes"}}})", &config, &error));
+}
+
+TEST(ParsePluginConfig, ReadsEndpoints) {
+  const std::string json = R"(
+{
+  "inspect": {
+    "destination": {
+      "endpoints": [
+        {"grpc_config": {"target_uri": "us-dlp.googleapis.com"}, "location_id": "us", "weight": 2},
+        {"grpcConfig": {"targetUri": "europe-dlp.googleapis.com"}, "locationId": "europe"},
+      ],
+      "max_consecutive_failures": 3,
+      "ejectionTimeMs": 10000
+    }
+  }
+})";
+  ::dlp::PluginConfig config;
+  std::string error;
+  ASSERT_TRUE(parsePluginConfig(json, &config, &error)) << error;
+  const ::dlp::Destination& destination = config.inspect().destination();
+  ASSERT_EQ(2, destination.endpoints_size());
+  EXPECT_EQ("us-dlp.googleapis.com", destination.endpoints(0).grpc_config().target_uri());
+  EXPECT_EQ("us", destination.endpoints(0).location_id());
+  EXPECT_EQ(2, destination.endpoints(0).weight());
+  EXPECT_EQ("europe", destination.endpoints(1).location_id());
+  EXPECT_EQ(0, destination.endpoints(1).weight());
+  EXPECT_EQ(3, destination.max_consecutive_failures());
+  EXPECT_EQ(10000, destination.ejection_time_ms());
+
+  EXPECT_FALSE(parsePluginConfig(
+      R"({"inspect": {"destination": {"endpoints": {"location_id": "us"}}}})", &config, &error));
+}
+
+TEST(ParsePluginConfig, ReadsHybridInspect) {
+  const std::string json = R"(
+{
+  "inspect": {
+    "destination": {
+      "operation": {
+        "hybridInspect": {
+          "job_trigger_name": "projects/p/locations/global/jobTriggers/t",
+          "max_batch_size": 20,
+          "maxBatchDelayMs": 500
+        }
+      }
+    },
+    "rate_limit": {"calls_per_second": 50, "burst": 100}
+  }
+})";
+  ::dlp::PluginConfig config;
+  std::string error;
+  ASSERT_TRUE(parsePluginConfig(json, &config, &error)) << error;
+  const ::dlp::HybridInspect& hybrid_inspect =
+      config.inspect().destination().operation().hybrid_inspect();
+  EXPECT_EQ("projects/p/locations/global/jobTriggers/t", hybrid_inspect.job_trigger_name());
+  EXPECT_EQ(20, hybrid_inspect.max_batch_size());
+  EXPECT_EQ(500, hybrid_inspect.max_batch_delay_ms());
+  EXPECT_EQ(50, config.inspect().rate_limit().calls_per_second());
+  EXPECT_EQ(100, config.inspect().rate_limit().burst());
+}
+
+TEST(ParsePluginConfig, ReadsCaptureRules) {
+  const std::string json = R"(
+{
+  "inspect": {
+    "captureRules": [
+      {"name": "images", "action": "SKIP", "content_types": ["image/"]},
+      {
+        "direction": "REQUEST",
+        "methods": ["POST", "PUT"],
+        "pathPrefixes": ["/api/"],
+        "path_patterns": ["/v*/users"],
+        "hosts": ["*.example.com"],
+        "min_status": 200,
+        "max_status": 299,
+        "min_body_bytes": 1,
+        "max_body_bytes": "65536"
+      }
+    ]
+  }
+})";
+  ::dlp::PluginConfig config;
+  std::string error;
+  ASSERT_TRUE(parsePluginConfig(json, &config, &error)) << error;
+  ASSERT_EQ(2, config.inspect().capture_rules_size());
+  const ::dlp::CaptureRule& images = config.inspect().capture_rules(0);
+  EXPECT_EQ("images", images.name());
+  EXPECT_EQ(::dlp::CaptureRule_Action_SKIP, images.action());
+  EXPECT_EQ("image/", images.content_types(0));
+  const ::dlp::CaptureRule& api = config.inspect().capture_rules(1);
+  EXPECT_EQ(::dlp::CaptureRule_Action_CAPTURE, api.action());
+  EXPECT_EQ(::dlp::CaptureRule_Direction_REQUEST, api.direction());
+  EXPECT_EQ(2, api.methods_size());
+  EXPECT_EQ("/api/", api.path_prefixes(0));
+  EXPECT_EQ("/v*/users", api.path_patterns(0));
+  EXPECT_EQ("*.example.com", api.hosts(0));
+  EXPECT_EQ(200, api.min_status());
+  EXPECT_EQ(299, api.max_status());
+  EXPECT_EQ(1, api.min_body_bytes());
+  EXPECT_EQ(65536, api.max_body_bytes());
+
+  EXPECT_FALSE(parsePluginConfig(
+      R"({"inspect": {"capture_rules": [{"action": "DROP"}]}})", &config, &error));
+  EXPECT_EQ("Unknown action: DROP", error);
+}
+
+TEST(ParsePluginConfig, ReadsSpoolConfig) {
+  const std::string json = R"(
+{
+  "inspect": {
+    "spool": {"maxBytes": "1048576", "max_entries": 200, "max_age_ms": 30000, "drainPerSecond": 5}
+  }
+})";
+  ::dlp::PluginConfig config;
+  std::string error;
+  ASSERT_TRUE(parsePluginConfig(json, &config, &error)) << error;
+  const ::dlp::SpoolConfig& spool = config.inspect().spool();
+  EXPECT_EQ(1048576, spool.max_bytes());
+  EXPECT_EQ(200, spool.max_entries());
+  EXPECT_EQ(30000, spool.max_age_ms());
+  EXPECT_EQ(5, spool.drain_per_second());
+}
+
+TEST(ParsePluginConfig, ReadsMinimizeConfig) {
+  const std::string json = R"(
+{
+  "inspect": {
+    "minimize": {"collapseWhitespace": true, "max_run_bytes": 64}
+  }
+})";
+  ::dlp::PluginConfig config;
+  std::string error;
+  ASSERT_TRUE(parsePluginConfig(json, &config, &error)) << error;
+  EXPECT_TRUE(config.inspect().minimize().collapse_whitespace());
+  EXPECT_EQ(64, config.inspect().minimize().max_run_bytes());
+}
+
+TEST(ParsePluginConfig, RejectsShortMaxRunBytes) {
+  ::dlp::PluginConfig config;
+  std::string error;
+  EXPECT_FALSE(parsePluginConfig(R"({"inspect": {"minimize": {"max_run_bytes": 16}}})",
+                                 &config, &error));
+  EXPECT_EQ("max_run_bytes has to be 0 or at least 64", error);
+  EXPECT_TRUE(parsePluginConfig(R"({"inspect": {"minimize": {"max_run_bytes": 0}}})",
+                                &config, &error)) << error;
+}
+
+TEST(ParsePluginConfig, ReadsLearnedSecretsConfig) {
+  ::dlp::PluginConfig config;
+  std::string error;
+  ASSERT_TRUE(parsePluginConfig(R"({"inspect": {}})", &config, &error)) << error;
+  EXPECT_FALSE(config.inspect().has_learned_secrets());
+  ASSERT_TRUE(parsePluginConfig(R"({"inspect": {"learnedSecrets": {}}})", &config, &error))
+      << error;
+  EXPECT_TRUE(config.inspect().has_learned_secrets());
+  ASSERT_TRUE(parsePluginConfig(
+      R"({"inspect": {"learned_secrets": {"maxEntries": 50, "ttl_ms": 60000}}})", &config, &error))
+      << error;
+  EXPECT_EQ(50, config.inspect().learned_secrets().max_entries());
+  EXPECT_EQ(60000, config.inspect().learned_secrets().ttl_ms());
+}
+
+TEST(ParsePluginConfig, ReadsCoalesceConfig) {
+  ::dlp::PluginConfig config;
+  std::string error;
+  ASSERT_TRUE(parsePluginConfig(R"({"inspect": {"coalesce": {}}})", &config, &error)) << error;
+  EXPECT_TRUE(config.inspect().has_coalesce());
+  ASSERT_TRUE(parsePluginConfig(
+      R"({"inspect": {"coalesce": {"maxDelayMs": 2000,
+                                   "request_headers": ["authorization", "cookie"]}}})",
+      &config, &error)) << error;
+  EXPECT_EQ(2000, config.inspect().coalesce().max_delay_ms());
+  ASSERT_EQ(2, config.inspect().coalesce().request_headers_size());
+  EXPECT_EQ("cookie", config.inspect().coalesce().request_headers(1));
+  EXPECT_FALSE(parsePluginConfig(
+      R"({"inspect": {"coalesce": {"request_headers": "cookie"}}})", &config, &error));
+}
+
+TEST(ParsePluginConfig, ReadsEnforceConfig) {
+  ::dlp::PluginConfig config;
+  std::string error;
+  ASSERT_TRUE(parsePluginConfig(R"({"inspect": {"enforce": {
+      "routes": ["payments"], "deadlineMs": 50, "fail_closed": true,
+      "statusCode": 451, "body": "blocked"}}})", &config, &error)) << error;
+  const ::dlp::EnforceConfig& enforce = config.inspect().enforce();
+  ASSERT_EQ(1, enforce.routes_size());
+  EXPECT_EQ("payments", enforce.routes(0));
+  EXPECT_EQ(50, enforce.deadline_ms());
+  EXPECT_TRUE(enforce.fail_closed());
+  EXPECT_EQ(451, enforce.status_code());
+  EXPECT_EQ("blocked", enforce.body());
+  EXPECT_FALSE(parsePluginConfig(
+      R"({"inspect": {"enforce": {"fail_closed": "yes"}}})", &config, &error));
+}
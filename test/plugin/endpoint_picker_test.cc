@@ -0,0 +1,115 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+#include "gtest/gtest.h"
+#include "plugin/endpoint/endpoint_picker.h"
+
+using google::dlp_filter::EndpointPicker;
+
+namespace {
+static const uint64_t Ms = 1000000;
+static const EndpointPicker::Options Options{3, 1000 * Ms};
+}
+
+TEST(EndpointPicker, SpreadsByWeight) {
+  EndpointPicker picker({1, 3}, Options, 1);
+  std::vector<int> picks(2);
+  for (int i = 0; i < 4000; i++) {
+    const size_t endpoint = picker.pick(0);
+    picks[endpoint]++;
+    picker.onSuccess(endpoint, 10 * Ms);
+  }
+  EXPECT_NEAR(1000, picks[0], 150);
+  EXPECT_NEAR(3000, picks[1], 150);
+}
+
+TEST(EndpointPicker, PrefersFasterEndpoint) {
+  EndpointPicker picker({1, 1}, Options, 1);
+  std::vector<int> picks(2);
+  for (int i = 0; i < 1000; i++) {
+    const size_t endpoint = picker.pick(0);
+    picks[endpoint]++;
+    picker.onSuccess(endpoint, endpoint == 0 ? 100 * Ms : 5 * Ms);
+  }
+  EXPECT_GT(picks[1], 900);
+  // The slow endpoint is still probed.
+  EXPECT_GT(picks[0], 0);
+}
+
+TEST(EndpointPicker, BalancesOutstandingCalls) {
+  EndpointPicker picker({1, 1}, Options, 1);
+  for (int i = 0; i < 100; i++) {
+    picker.pick(0);
+  }
+  EXPECT_EQ(100, picker.outstanding(0) + picker.outstanding(1));
+  EXPECT_NEAR(picker.outstanding(0), picker.outstanding(1), 6);
+}
+
+TEST(EndpointPicker, EjectsAfterConsecutiveFailures) {
+  EndpointPicker picker({1}, Options, 1);
+  EXPECT_FALSE(picker.onFailure(picker.pick(0), 0));
+  EXPECT_FALSE(picker.onFailure(picker.pick(0), 0));
+  EXPECT_TRUE(picker.onFailure(picker.pick(0), 0));
+  EXPECT_TRUE(picker.isEjected(0, 0));
+  EXPECT_TRUE(picker.isEjected(0, 999 * Ms));
+  EXPECT_FALSE(picker.hasAvailable(999 * Ms));
+  EXPECT_FALSE(picker.isEjected(0, 1000 * Ms));
+  EXPECT_TRUE(picker.hasAvailable(1000 * Ms));
+
+  // A success in between resets the count.
+  EXPECT_FALSE(picker.onFailure(picker.pick(1000 * Ms), 1000 * Ms));
+  picker.onSuccess(picker.pick(1000 * Ms), Ms);
+  EXPECT_FALSE(picker.onFailure(picker.pick(1000 * Ms), 1000 * Ms));
+  EXPECT_FALSE(picker.onFailure(picker.pick(1000 * Ms), 1000 * Ms));
+  EXPECT_EQ(0, picker.outstanding(0));
+}
+
+TEST(EndpointPicker, SkipsEjectedEndpoint) {
+  EndpointPicker picker({1, 1}, Options, 1);
+  // Fail every call to endpoint 0 until it is ejected.
+  bool ejected = false;
+  for (int i = 0; i < 100 && !ejected; i++) {
+    const size_t endpoint = picker.pick(0);
+    if (endpoint == 0) {
+      ejected = picker.onFailure(endpoint, 0);
+    } else {
+      picker.onSuccess(endpoint, Ms);
+    }
+  }
+  ASSERT_TRUE(ejected);
+
+  for (int i = 0; i < 10; i++) {
+    const size_t endpoint = picker.pick(500 * Ms);
+    EXPECT_EQ(1, endpoint);
+    picker.onSuccess(endpoint, Ms);
+  }
+
+  bool picked_again = false;
+  for (int i = 0; i < 100 && !picked_again; i++) {
+    const size_t endpoint = picker.pick(1000 * Ms);
+    picked_again = endpoint == 0;
+    picker.onSuccess(endpoint, Ms);
+  }
+  EXPECT_TRUE(picked_again);
+}
+
+TEST(EndpointPicker, UsesFirstReturningEndpointWhenAllEjected) {
+  EndpointPicker picker({1}, Options, 1);
+  for (int i = 0; i < 3; i++) {
+    picker.onFailure(picker.pick(0), 0);
+  }
+  EXPECT_EQ(0, picker.pick(10 * Ms));
+  EXPECT_EQ(1, picker.outstanding(0));
+}
@@ -14,12 +14,21 @@
 
 #include "plugin/filter.h"
 
+#include <map>
+
+#include "google/privacy/dlp/v2/dlp.pb.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "include/proxy-wasm/context.h"
 #include "include/proxy-wasm/null.h"
 
+using google::privacy::dlp::v2::Finding;
+using google::privacy::dlp::v2::InspectContentRequest;
+using google::privacy::dlp::v2::InspectContentResponse;
+using google::privacy::dlp::v2::Table;
 using testing::_;
+using testing::AnyNumber;
+using testing::HasSubstr;
 using testing::Invoke;
 
 namespace proxy_wasm {
@@ -51,8 +60,30 @@ class MockContext : public proxy_wasm::ContextBase {
               (uint32_t /* response_code */, std::string_view /* body */,
                   Pairs /* additional_headers */, uint32_t /* grpc_status */,
                   std::string_view /* details */));
+  MOCK_METHOD(WasmResult, continueStream, (WasmStreamType /* stream_type */));
+  MOCK_METHOD(uint64_t, getCurrentTimeNanoseconds, ());
+  MOCK_METHOD(WasmResult, defineMetric,
+              (uint32_t /* metric_type */, std::string_view /* name */,
+                  uint32_t * /* metric_id_ptr */));
+  MOCK_METHOD(WasmResult, incrementMetric, (uint32_t /* metric_id */, int64_t /* offset */));
 };
 
+// Adds a finding of info_type at [start, end) of the message, or of the value
+// in row row_index of a table
+void addFinding(InspectContentResponse* response, const std::string& info_type,
+                int64_t start, int64_t end, int64_t row_index = -1) {
+  Finding* finding = response->mutable_result()->add_findings();
+  finding->mutable_info_type()->set_name(info_type);
+  finding->mutable_location()->mutable_byte_range()->set_start(start);
+  finding->mutable_location()->mutable_byte_range()->set_end(end);
+  if (row_index >= 0) {
+    auto* record = finding->mutable_location()->add_content_locations()
+        ->mutable_record_location();
+    record->mutable_field_id()->set_name("value");
+    record->mutable_table_location()->set_row_index(row_index);
+  }
+}
+
 class DlpTest : public ::testing::Test {
  protected:
   DlpTest() {
@@ -73,8 +104,60 @@ class DlpTest : public ::testing::Test {
         });
 
     ON_CALL(*mock_context_, getProperty(_, _))
-        .WillByDefault([](std::string_view m, std::string*) {
+        .WillByDefault([&](std::string_view m, std::string* result) {
           std::cerr << m << "\n";
+          // Property paths are null terminated.
+          if (m.substr(0, m.find('\0')) == "route_name") {
+            *result = route_;
+          }
+          return WasmResult::Ok;
+        });
+
+    ON_CALL(*mock_context_, getCurrentTimeNanoseconds())
+        .WillByDefault([&]() { return now_ns_; });
+
+    ON_CALL(*mock_context_, defineMetric(_, _, _))
+        .WillByDefault([&](uint32_t, std::string_view name, uint32_t* metric_id_ptr) {
+          *metric_id_ptr = ++metric_count_;
+          metric_ids_[std::string(name)] = *metric_id_ptr;
+          return WasmResult::Ok;
+        });
+
+    ON_CALL(*mock_context_, incrementMetric(_, _))
+        .WillByDefault([&](uint32_t metric_id, int64_t offset) {
+          metric_values_[metric_id] += offset;
+          return WasmResult::Ok;
+        });
+
+    ON_CALL(*mock_context_, getBuffer(_))
+        .WillByDefault([&](WasmBufferType type) -> BufferInterface* {
+          switch (type) {
+            case WasmBufferType::PluginConfiguration:
+              buffer_.set(configuration_);
+              return &buffer_;
+            case WasmBufferType::HttpRequestBody:
+              buffer_.set(request_body_);
+              return &buffer_;
+            case WasmBufferType::HttpResponseBody:
+              buffer_.set(response_body_);
+              return &buffer_;
+            case WasmBufferType::GrpcReceiveBuffer:
+              buffer_.set(grpc_response_);
+              return &buffer_;
+            default:
+              return nullptr;
+          }
+        });
+
+    // Records the InspectContent requests, call i + 1 getting token i + 1
+    ON_CALL(*mock_context_, grpcCall(_, _, _, _, _, _, _))
+        .WillByDefault([&](std::string_view, std::string_view, std::string_view,
+                           const Pairs&, std::string_view request,
+                           std::chrono::milliseconds timeout, GrpcToken* token_ptr) {
+          calls_.emplace_back();
+          calls_.back().ParseFromString(std::string(request));
+          timeouts_.push_back(timeout);
+          *token_ptr = static_cast<GrpcToken>(calls_.size());
           return WasmResult::Ok;
         });
 
@@ -88,6 +171,9 @@ class DlpTest : public ::testing::Test {
           if (header == ":method") {
             *result = method_;
           }
+          if (header == ":authority") {
+            *result = authority_;
+          }
           if (header == "authorization") {
             *result = authorization_header_;
           }
@@ -100,6 +186,44 @@ class DlpTest : public ::testing::Test {
   }
   ~DlpTest() override {}
 
+  // Configures the plugin to inspect every message and store findings
+  // locally, or run the given operations, with the given additional inspect
+  // fields
+  void configure(const std::string& inspect_fields,
+                 const std::string& operations = R"("store_local": {
+          "project_id": "{project_id}",
+        })") {
+    configuration_ = R"({
+  "inspect": {
+    "destination": {
+      "operation": {
+        )" + operations + R"(
+      }
+    },
+    "sampling": {
+      "probability": {
+        "numerator": 100,
+        "denominator": "HUNDRED"
+      }
+    },
+    )" + inspect_fields + R"(
+  }
+})";
+    ASSERT_TRUE(root_context_->onConfigure(configuration_.size()));
+  }
+
+  // Value reported to the host for the counter name
+  int64_t metricValue(const std::string& name) {
+    auto metric_id = metric_ids_.find(name);
+    return metric_id != metric_ids_.end() ? metric_values_[metric_id->second] : 0;
+  }
+
+  // Completes the call of token with response
+  void respond(GrpcToken token, const InspectContentResponse& response) {
+    grpc_response_ = response.SerializeAsString();
+    root_context_->onGrpcReceive(token, grpc_response_.size());
+  }
+
   std::unique_ptr<WasmBase> wasm_base_;
   std::unique_ptr<WasmVm> test_vm_;
   std::unique_ptr<MockContext> mock_context_;
@@ -109,8 +233,25 @@ class DlpTest : public ::testing::Test {
 
   std::string path_;
   std::string method_;
+  std::string authority_;
   std::string cred_;
   std::string authorization_header_;
+  std::string route_;
+  uint64_t now_ns_ = 1000000000;
+  uint32_t metric_count_ = 0;
+  std::map<std::string, uint32_t> metric_ids_;
+  std::map<uint32_t, int64_t> metric_values_;
+
+  // Contents of the buffers read by the plugin
+  BufferBase buffer_;
+  std::string configuration_;
+  std::string request_body_;
+  std::string response_body_;
+  std::string grpc_response_;
+
+  // Calls sent to Cloud DLP, by token - 1
+  std::vector<InspectContentRequest> calls_;
+  std::vector<std::chrono::milliseconds> timeouts_;
 };
 
 TEST_F(DlpTest, ValidRequest) {
@@ -184,6 +325,394 @@ TEST_F(DlpTest, ValidRequest) {
   EXPECT_NE(token, nullptr);
 }
 
+// Responses of the "payments" route are held until inspected.
+static const char EnforceConfig[] = R"("enforce": {
+      "routes": ["payments"],
+      "deadline_ms": 50,
+      "status_code": 451,
+      "body": "blocked"
+    })";
+
+static const char EnforceFailClosedConfig[] = R"("enforce": {
+      "routes": ["payments"],
+      "deadline_ms": 50,
+      "fail_closed": true,
+      "status_code": 451,
+      "body": "blocked"
+    })";
+
+TEST_F(DlpTest, EnforcedCleanResponseContinues) {
+  configure(EnforceConfig);
+  route_ = "payments";
+
+  EXPECT_EQ(FilterHeadersStatus::StopIteration, context_->onResponseHeaders(0, false));
+  response_body_ = "{\"balance\": 10}";
+  EXPECT_EQ(FilterDataStatus::StopIterationAndBuffer,
+            context_->onResponseBody(response_body_.size(), true));
+  ASSERT_EQ(1u, calls_.size());
+  EXPECT_EQ(response_body_, calls_[0].item().byte_item().data());
+  // The deadline is not the call timeout.
+  EXPECT_EQ(10000, timeouts_[0].count());
+
+  EXPECT_CALL(*mock_context_, sendLocalResponse(_, _, _, _, _)).Times(0);
+  EXPECT_CALL(*mock_context_, continueStream(WasmStreamType::Response));
+  respond(1, InspectContentResponse());
+}
+
+TEST_F(DlpTest, EnforcedResponseWithFindingsIsReplaced) {
+  configure(EnforceConfig);
+  route_ = "payments";
+
+  EXPECT_EQ(FilterHeadersStatus::StopIteration, context_->onResponseHeaders(0, false));
+  response_body_ = "{\"ssn\": \"987-65-4321\"}";
+  EXPECT_EQ(FilterDataStatus::StopIterationAndBuffer,
+            context_->onResponseBody(response_body_.size(), true));
+  ASSERT_EQ(1u, calls_.size());
+
+  EXPECT_CALL(*mock_context_, continueStream(_)).Times(0);
+  EXPECT_CALL(*mock_context_, sendLocalResponse(451, "blocked", _, _, "dlp_enforced"));
+  InspectContentResponse response;
+  addFinding(&response, "US_SOCIAL_SECURITY_NUMBER", 9, 20);
+  respond(1, response);
+}
+
+TEST_F(DlpTest, EnforcedResponseExpiresOpen) {
+  configure(EnforceConfig);
+  route_ = "payments";
+
+  EXPECT_EQ(FilterHeadersStatus::StopIteration, context_->onResponseHeaders(0, false));
+  response_body_ = "{\"ssn\": \"987-65-4321\"}";
+  EXPECT_EQ(FilterDataStatus::StopIterationAndBuffer,
+            context_->onResponseBody(response_body_.size(), true));
+  ASSERT_EQ(1u, calls_.size());
+
+  EXPECT_CALL(*mock_context_, sendLocalResponse(_, _, _, _, _)).Times(0);
+  EXPECT_CALL(*mock_context_, continueStream(_)).Times(0);
+  now_ns_ += 49000000;
+  root_context_->onTick();
+  testing::Mock::VerifyAndClearExpectations(mock_context_.get());
+
+  EXPECT_CALL(*mock_context_, sendLocalResponse(_, _, _, _, _)).Times(0);
+  EXPECT_CALL(*mock_context_, continueStream(WasmStreamType::Response));
+  now_ns_ += 1000000;
+  root_context_->onTick();
+  testing::Mock::VerifyAndClearExpectations(mock_context_.get());
+
+  // The call still completes, and its findings are reported.
+  EXPECT_CALL(*mock_context_, continueStream(_)).Times(0);
+  EXPECT_CALL(*mock_context_, log(_, _)).Times(AnyNumber());
+  EXPECT_CALL(*mock_context_, log(_, HasSubstr("DLP_DETECTED:US_SOCIAL_SECURITY_NUMBER:9-20")));
+  InspectContentResponse response;
+  addFinding(&response, "US_SOCIAL_SECURITY_NUMBER", 9, 20);
+  respond(1, response);
+}
+
+TEST_F(DlpTest, EnforcedResponseExpiresClosed) {
+  configure(EnforceFailClosedConfig);
+  route_ = "payments";
+
+  EXPECT_EQ(FilterHeadersStatus::StopIteration, context_->onResponseHeaders(0, false));
+  response_body_ = "{\"balance\": 10}";
+  EXPECT_EQ(FilterDataStatus::StopIterationAndBuffer,
+            context_->onResponseBody(response_body_.size(), true));
+  ASSERT_EQ(1u, calls_.size());
+
+  EXPECT_CALL(*mock_context_, continueStream(_)).Times(0);
+  EXPECT_CALL(*mock_context_, sendLocalResponse(451, "blocked", _, _, "dlp_enforced"));
+  now_ns_ += 50000000;
+  root_context_->onTick();
+  testing::Mock::VerifyAndClearExpectations(mock_context_.get());
+
+  EXPECT_CALL(*mock_context_, continueStream(_)).Times(0);
+  EXPECT_CALL(*mock_context_, sendLocalResponse(_, _, _, _, _)).Times(0);
+  respond(1, InspectContentResponse());
+}
+
+TEST_F(DlpTest, ThrottledEnforcedResponseFails) {
+  configure(std::string(EnforceConfig) + R"(,
+    "rate_limit": {
+      "calls_per_second": 1
+    })");
+  route_ = "payments";
+
+  EXPECT_EQ(FilterHeadersStatus::StopIteration, context_->onResponseHeaders(0, false));
+  response_body_ = "{\"balance\": 10}";
+  EXPECT_EQ(FilterDataStatus::StopIterationAndBuffer,
+            context_->onResponseBody(response_body_.size(), true));
+  ASSERT_EQ(1u, calls_.size());
+
+  // Failing open, the throttled response goes on right away.
+  DlpContext throttled(2, root_context_.get());
+  EXPECT_CALL(*mock_context_, sendLocalResponse(_, _, _, _, _)).Times(0);
+  EXPECT_EQ(FilterHeadersStatus::StopIteration, throttled.onResponseHeaders(0, false));
+  EXPECT_EQ(FilterDataStatus::Continue, throttled.onResponseBody(response_body_.size(), true));
+  EXPECT_EQ(1u, calls_.size());
+}
+
+TEST_F(DlpTest, TooLargeEnforcedResponseFails) {
+  configure(std::string(EnforceFailClosedConfig) + R"(,
+    "max_request_size_bytes": 8)");
+  route_ = "payments";
+
+  EXPECT_CALL(*mock_context_, sendLocalResponse(451, "blocked", _, _, "dlp_enforced"));
+  EXPECT_EQ(FilterHeadersStatus::StopIteration, context_->onResponseHeaders(0, false));
+  response_body_ = "{\"balance\": 10}";
+  EXPECT_EQ(FilterDataStatus::StopIterationNoBuffer,
+            context_->onResponseBody(response_body_.size(), true));
+  EXPECT_TRUE(calls_.empty());
+}
+
+TEST_F(DlpTest, EnforcedResponseEndsWithTrailers) {
+  configure(EnforceConfig);
+  route_ = "payments";
+
+  EXPECT_EQ(FilterHeadersStatus::StopIteration, context_->onResponseHeaders(0, false));
+  response_body_ = "{\"balance\": 10}";
+  EXPECT_EQ(FilterDataStatus::StopIterationAndBuffer,
+            context_->onResponseBody(response_body_.size(), false));
+  EXPECT_TRUE(calls_.empty());
+  EXPECT_EQ(FilterTrailersStatus::StopIteration, context_->onResponseTrailers(0));
+  ASSERT_EQ(1u, calls_.size());
+  EXPECT_EQ(response_body_, calls_[0].item().byte_item().data());
+
+  EXPECT_CALL(*mock_context_, continueStream(WasmStreamType::Response));
+  respond(1, InspectContentResponse());
+}
+
+TEST_F(DlpTest, EnforcedStreamGoneBeforeVerdict) {
+  configure(EnforceFailClosedConfig);
+  route_ = "payments";
+
+  EXPECT_EQ(FilterHeadersStatus::StopIteration, context_->onResponseHeaders(0, false));
+  response_body_ = "{\"ssn\": \"987-65-4321\"}";
+  EXPECT_EQ(FilterDataStatus::StopIterationAndBuffer,
+            context_->onResponseBody(response_body_.size(), true));
+  ASSERT_EQ(1u, calls_.size());
+  EXPECT_TRUE(context_->onDone());
+  context_.reset();
+
+  EXPECT_CALL(*mock_context_, continueStream(_)).Times(0);
+  EXPECT_CALL(*mock_context_, sendLocalResponse(_, _, _, _, _)).Times(0);
+  now_ns_ += 50000000;
+  root_context_->onTick();
+  EXPECT_CALL(*mock_context_, log(_, _)).Times(AnyNumber());
+  EXPECT_CALL(*mock_context_, log(_, HasSubstr("DLP_DETECTED:US_SOCIAL_SECURITY_NUMBER:9-20")));
+  InspectContentResponse response;
+  addFinding(&response, "US_SOCIAL_SECURITY_NUMBER", 9, 20);
+  respond(1, response);
+}
+
+// Requests wait up to a second for their response, sent with their
+// authorization header.
+static const char CoalesceConfig[] = R"("coalesce": {
+      "max_delay_ms": 1000,
+      "request_headers": ["authorization"]
+    })";
+
+TEST_F(DlpTest, CoalescesRequestWithResponse) {
+  configure(CoalesceConfig);
+  authority_ = "api.example.com";
+  path_ = "/users";
+  authorization_header_ = "Bearer abc";
+
+  EXPECT_EQ(FilterHeadersStatus::Continue, context_->onRequestHeaders(0, false));
+  request_body_ = "{\"name\": \"Jane\"}";
+  EXPECT_EQ(FilterDataStatus::Continue, context_->onRequestBody(request_body_.size(), true));
+  EXPECT_TRUE(calls_.empty());
+
+  EXPECT_EQ(FilterHeadersStatus::Continue, context_->onResponseHeaders(0, false));
+  response_body_ = "{\"id\": 7}";
+  EXPECT_EQ(FilterDataStatus::Continue, context_->onResponseBody(response_body_.size(), true));
+  ASSERT_EQ(1u, calls_.size());
+  const Table& table = calls_[0].item().table();
+  ASSERT_EQ(3, table.headers_size());
+  EXPECT_EQ("value", table.headers(2).name());
+  ASSERT_EQ(4, table.rows_size());
+  const std::vector<std::vector<std::string>> expected_rows = {
+      {"request", "url", "api.example.com/users"},
+      {"request", "header.authorization", "Bearer abc"},
+      {"request", "body", request_body_},
+      {"response", "body", response_body_}};
+  for (int i = 0; i < table.rows_size(); i++) {
+    ASSERT_EQ(3, table.rows(i).values_size());
+    for (int k = 0; k < 3; k++) {
+      EXPECT_EQ(expected_rows[i][k], table.rows(i).values(k).string_value());
+    }
+  }
+}
+
+TEST_F(DlpTest, ReleasesRequestAfterMaxDelay) {
+  configure(CoalesceConfig);
+  authority_ = "api.example.com";
+  path_ = "/users";
+
+  EXPECT_EQ(FilterHeadersStatus::Continue, context_->onRequestHeaders(0, false));
+  request_body_ = "{\"name\": \"Jane\"}";
+  EXPECT_EQ(FilterDataStatus::Continue, context_->onRequestBody(request_body_.size(), true));
+  now_ns_ += 999000000;
+  root_context_->onTick();
+  EXPECT_TRUE(calls_.empty());
+
+  now_ns_ += 1000000;
+  root_context_->onTick();
+  ASSERT_EQ(1u, calls_.size());
+  const Table& table = calls_[0].item().table();
+  ASSERT_EQ(2, table.rows_size());
+  EXPECT_EQ("url", table.rows(0).values(1).string_value());
+  EXPECT_EQ(request_body_, table.rows(1).values(2).string_value());
+
+  // The response comes too late to be sent along.
+  response_body_ = "{\"id\": 7}";
+  EXPECT_EQ(FilterDataStatus::Continue, context_->onResponseBody(response_body_.size(), true));
+  ASSERT_EQ(2u, calls_.size());
+  EXPECT_EQ(response_body_, calls_[1].item().byte_item().data());
+}
+
+TEST_F(DlpTest, ReleasesRequestWhenStreamEnds) {
+  configure(CoalesceConfig);
+
+  EXPECT_EQ(FilterHeadersStatus::Continue, context_->onRequestHeaders(0, false));
+  request_body_ = "{\"name\": \"Jane\"}";
+  EXPECT_EQ(FilterDataStatus::Continue, context_->onRequestBody(request_body_.size(), true));
+  EXPECT_TRUE(calls_.empty());
+
+  EXPECT_TRUE(context_->onDone());
+  ASSERT_EQ(1u, calls_.size());
+  const Table& table = calls_[0].item().table();
+  ASSERT_EQ(2, table.rows_size());
+  EXPECT_EQ("request", table.rows(1).values(0).string_value());
+  EXPECT_EQ(request_body_, table.rows(1).values(2).string_value());
+}
+
+TEST_F(DlpTest, SendsEnforcedResponseAlone) {
+  configure(std::string(CoalesceConfig) + ",\n    " + EnforceConfig);
+  route_ = "payments";
+
+  EXPECT_EQ(FilterHeadersStatus::Continue, context_->onRequestHeaders(0, false));
+  request_body_ = "{\"amount\": 10}";
+  EXPECT_EQ(FilterDataStatus::Continue, context_->onRequestBody(request_body_.size(), true));
+  EXPECT_TRUE(calls_.empty());
+
+  EXPECT_EQ(FilterHeadersStatus::StopIteration, context_->onResponseHeaders(0, false));
+  response_body_ = "{\"balance\": 10}";
+  EXPECT_EQ(FilterDataStatus::StopIterationAndBuffer,
+            context_->onResponseBody(response_body_.size(), true));
+  ASSERT_EQ(2u, calls_.size());
+  const Table& table = calls_[0].item().table();
+  ASSERT_EQ(2, table.rows_size());
+  EXPECT_EQ(request_body_, table.rows(1).values(2).string_value());
+  EXPECT_EQ(response_body_, calls_[1].item().byte_item().data());
+}
+
+TEST_F(DlpTest, AttributesFindingsToRows) {
+  configure(CoalesceConfig);
+  authority_ = "api.example.com";
+  path_ = "/users?email=jane@example.com";
+
+  EXPECT_EQ(FilterHeadersStatus::Continue, context_->onRequestHeaders(0, false));
+  request_body_ = "{\"name\": \"Jane\"}";
+  EXPECT_EQ(FilterDataStatus::Continue, context_->onRequestBody(request_body_.size(), true));
+  response_body_ = "{\"ssn\": \"987-65-4321\"}";
+  EXPECT_EQ(FilterDataStatus::Continue, context_->onResponseBody(response_body_.size(), true));
+  ASSERT_EQ(1u, calls_.size());
+  ASSERT_EQ(3, calls_[0].item().table().rows_size());
+
+  EXPECT_CALL(*mock_context_, log(_, _)).Times(AnyNumber());
+  EXPECT_CALL(*mock_context_,
+              log(_, HasSubstr("DLP_DETECTED:EMAIL_ADDRESS:28-44:request:url")));
+  EXPECT_CALL(*mock_context_,
+              log(_, HasSubstr("DLP_DETECTED:US_SOCIAL_SECURITY_NUMBER:9-20:response:body")));
+  InspectContentResponse response;
+  addFinding(&response, "EMAIL_ADDRESS", 28, 44, 0);
+  addFinding(&response, "US_SOCIAL_SECURITY_NUMBER", 9, 20, 2);
+  respond(1, response);
+}
+
+TEST_F(DlpTest, LogsNoLocationInBinaryRows) {
+  configure(CoalesceConfig);
+
+  EXPECT_EQ(FilterHeadersStatus::Continue, context_->onRequestHeaders(0, false));
+  // Invalid UTF-8 is replaced in the cell, moving the SSN by two bytes.
+  request_body_ = std::string("\x89PNG\r\n\x1a\n\0\0\0\rIHDR 987-65-4321", 28);
+  EXPECT_EQ(FilterDataStatus::Continue, context_->onRequestBody(request_body_.size(), true));
+  response_body_ = "{\"ssn\": \"987-65-4321\"}";
+  EXPECT_EQ(FilterDataStatus::Continue, context_->onResponseBody(response_body_.size(), true));
+  ASSERT_EQ(1u, calls_.size());
+  ASSERT_EQ(3, calls_[0].item().table().rows_size());
+
+  EXPECT_CALL(*mock_context_, log(_, _)).Times(AnyNumber());
+  EXPECT_CALL(*mock_context_,
+              log(_, HasSubstr("DLP_DETECTED:US_SOCIAL_SECURITY_NUMBER:request:body")));
+  EXPECT_CALL(*mock_context_,
+              log(_, HasSubstr("DLP_DETECTED:US_SOCIAL_SECURITY_NUMBER:9-20:response:body")));
+  InspectContentResponse response;
+  addFinding(&response, "US_SOCIAL_SECURITY_NUMBER", 19, 30, 1);
+  addFinding(&response, "US_SOCIAL_SECURITY_NUMBER", 9, 20, 2);
+  respond(1, response);
+}
+
+TEST_F(DlpTest, FlushesStatsEveryFlushInterval) {
+  // Enforcement ticks every 25 ms, stats are still flushed every second.
+  configure(std::string(EnforceConfig) + R"(,
+    "stats": {
+      "flush_interval_ms": 1000
+    })");
+  route_ = "payments";
+  const uint64_t configured_ns = now_ns_;
+
+  EXPECT_EQ(FilterHeadersStatus::StopIteration, context_->onResponseHeaders(0, false));
+  response_body_ = "{\"balance\": 10}";
+  EXPECT_EQ(FilterDataStatus::StopIterationAndBuffer,
+            context_->onResponseBody(response_body_.size(), true));
+  respond(1, InspectContentResponse());
+
+  EXPECT_CALL(*mock_context_, incrementMetric(_, _)).Times(0);
+  for (now_ns_ = configured_ns + 25000000; now_ns_ < configured_ns + 1000000000;
+       now_ns_ += 25000000) {
+    root_context_->onTick();
+  }
+  testing::Mock::VerifyAndClearExpectations(mock_context_.get());
+
+  EXPECT_CALL(*mock_context_, incrementMetric(_, _)).Times(testing::AtLeast(1));
+  root_context_->onTick();
+  testing::Mock::VerifyAndClearExpectations(mock_context_.get());
+
+  // Counts of the next interval wait for it to pass.
+  DlpContext next(2, root_context_.get());
+  request_body_ = "{\"amount\": 10}";
+  EXPECT_EQ(FilterDataStatus::Continue, next.onRequestBody(request_body_.size(), true));
+  EXPECT_CALL(*mock_context_, incrementMetric(_, _)).Times(0);
+  now_ns_ += 25000000;
+  root_context_->onTick();
+}
+
+TEST_F(DlpTest, RecordsSavedBytesOnceWithHybridInspect) {
+  configure(std::string(CoalesceConfig) + R"(,
+    "minimize": {
+      "collapse_whitespace": true
+    })",
+            R"("store_local": {
+          "project_id": "{project_id}",
+        },
+        "hybrid_inspect": {
+          "job_trigger_name": "projects/p/locations/global/jobTriggers/t"
+        })");
+
+  EXPECT_EQ(FilterHeadersStatus::Continue, context_->onRequestHeaders(0, false));
+  // Each body is minimized for the batch and for the coalesced call, and
+  // saves 3 bytes.
+  request_body_ = "{\"name\":    \"Jane\"}";
+  EXPECT_EQ(FilterDataStatus::Continue, context_->onRequestBody(request_body_.size(), true));
+  response_body_ = "{\"id\":    7}";
+  EXPECT_EQ(FilterDataStatus::Continue, context_->onResponseBody(response_body_.size(), true));
+  ASSERT_EQ(1u, calls_.size());
+  ASSERT_EQ(3, calls_[0].item().table().rows_size());
+  EXPECT_EQ("{\"name\": \"Jane\"}", calls_[0].item().table().rows(1).values(2).string_value());
+
+  EXPECT_TRUE(root_context_->onDone());
+  EXPECT_EQ(6, metricValue("dlp_stat_total_bytes_saved"));
+}
+
 }  // namespace dlp
 }  // namespace null_plugin
 }  // namespace proxy_wasm
\ No newline at end of file
@@ -0,0 +1,180 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <random>
+#include <string>
+#include "gtest/gtest.h"
+#include "plugin/minimize/minimizer.h"
+
+using google::dlp_filter::Minimizer;
+using google::dlp_filter::OffsetMap;
+
+namespace {
+int byteClass(uint8_t byte) {
+  if (isalnum(byte) || byte == '+' || byte == '/' || byte == '=' || byte == '-' || byte == '_') {
+    return 1;
+  }
+  if (byte == ' ' || (byte >= '\t' && byte <= '\r')) {
+    return 2;
+  }
+  if (byte < 0x20 || byte >= 0x7f) {
+    return 3;
+  }
+  return 0;
+}
+
+// Digits of the run of digits and dashes holding body[i]
+size_t numberDigits(const std::string& body, size_t i) {
+  const auto number = [&](size_t j) { return isdigit(body[j]) || body[j] == '-'; };
+  if (!number(i)) {
+    return 0;
+  }
+  size_t first = i;
+  while (first > 0 && number(first - 1)) {
+    first--;
+  }
+  size_t digits = 0;
+  for (size_t j = first; j < body.size() && number(j); j++) {
+    digits += body[j] != '-';
+  }
+  return digits;
+}
+
+// Byte by byte minimization, along with the original offset of every kept
+// byte
+std::string naiveMinimize(
+    const std::string& body, Minimizer::Options options, std::vector<size_t>* offsets) {
+  std::string out;
+  offsets->clear();
+  size_t pos = 0;
+  while (pos < body.size()) {
+    const int run_class = byteClass(body[pos]);
+    size_t end = pos;
+    bool control = false;
+    while (end < body.size() && byteClass(body[end]) == run_class) {
+      control |= static_cast<uint8_t>(body[end]) < 0x80;
+      end++;
+    }
+    size_t keep = end - pos;
+    if (run_class == 2 && options.collapse_whitespace) {
+      keep = 1;
+    } else if ((run_class == 1 || (run_class == 3 && control)) && options.max_run_bytes > 0) {
+      keep = std::min(keep, options.max_run_bytes);
+    }
+    for (size_t i = pos; i < end; i++) {
+      if (i >= pos + keep && (run_class != 1 || numberDigits(body, i) < 13)) {
+        continue;
+      }
+      out += body[i];
+      offsets->push_back(i);
+    }
+    pos = end;
+  }
+  return out;
+}
+
+std::string minimize(const std::string& body, Minimizer::Options options) {
+  std::string out;
+  OffsetMap offsets;
+  Minimizer(options).minimize(body, &out, &offsets);
+  return out;
+}
+}
+
+TEST(Minimizer, CollapsesWhitespace) {
+  EXPECT_EQ("{ \"a\": 1,\n\"b\":\t2 }",
+            minimize("{   \"a\":    1,\n\n   \"b\":\t 2  }", {true, 0}));
+  EXPECT_EQ("a  b", minimize("a  b", {false, 16}));
+}
+
+TEST(Minimizer, TruncatesLongTokenRuns) {
+  const std::string image = "data:image/png;base64," + std::string(300, 'Q') + "==";
+  EXPECT_EQ("data:image/png;base64," + std::string(16, 'Q'), minimize(image, {false, 16}));
+  EXPECT_EQ("id:0123456789abcdef rest",
+            minimize("id:0123456789abcdef0123456789abcdef rest", {false, 16}));
+  // Short tokens are kept whole.
+  EXPECT_EQ("SSN 123-45-6789.", minimize("SSN 123-45-6789.", {true, 16}));
+}
+
+TEST(Minimizer, TruncatesBinaryRunsButNotText) {
+  std::string binary("\x89PNG\r\n\x1a\n", 8);
+  binary += std::string("\x00\x01\x02\xff\xfe\x80\x90\x10\x00\x00\xee\x7f", 12);
+  std::string body = "pre " + binary.substr(8) + " post";
+  EXPECT_EQ("pre " + binary.substr(8, 4) + " post", minimize(body, {false, 4}));
+  const std::string utf8 = "na\xc3\xafve \xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae";
+  EXPECT_EQ(utf8, minimize(utf8, {true, 4}));
+}
+
+TEST(Minimizer, KeepsCardNumbersInTruncatedRuns) {
+  const std::string prefix(80, 'Q');
+  const std::string body =
+      "blob:" + prefix + "4111111111111111" + std::string(40, 'x') + "4111-1111-1111-1111" + "yy";
+  std::string out;
+  OffsetMap offsets;
+  Minimizer({false, 64}).minimize(body, &out, &offsets);
+  ASSERT_EQ("blob:" + prefix.substr(0, 64) + "4111111111111111" + "4111-1111-1111-1111", out);
+  EXPECT_EQ(body.find("4111111111111111"), offsets.original(out.find("4111111111111111")));
+  EXPECT_EQ(body.find("4111-"), offsets.original(out.find("4111-")));
+  // A number the cut falls in is kept whole, shorter ones are not kept.
+  EXPECT_EQ(std::string(6, 'a') + "4111111111111111",
+            minimize(std::string(6, 'a') + "4111111111111111" + std::string(20, 'b'), {false, 8}));
+  EXPECT_EQ(std::string(8, 'a'),
+            minimize(std::string(8, 'a') + "123456789012" + std::string(20, 'b'), {false, 8}));
+}
+
+TEST(Minimizer, MapsOffsetsToOriginal) {
+  const std::string body = "a    b " + std::string(40, 'x') + " c";
+  std::string out;
+  OffsetMap offsets;
+  const size_t dropped = Minimizer({true, 8}).minimize(body, &out, &offsets);
+  ASSERT_EQ("a b " + std::string(8, 'x') + " c", out);
+  EXPECT_EQ(body.size() - out.size(), dropped);
+  EXPECT_EQ(0, offsets.original(0));
+  EXPECT_EQ(1, offsets.original(1));
+  EXPECT_EQ(5, offsets.original(2));
+  EXPECT_EQ(body.find('c'), offsets.original(out.find('c')));
+  // A range ending with the truncated run does not cover its dropped bytes.
+  EXPECT_EQ(15, offsets.originalEnd(12));
+
+  Minimizer({true, 8}).minimize("nothing to drop", &out, &offsets);
+  EXPECT_TRUE(offsets.empty());
+  EXPECT_EQ(7, offsets.original(7));
+}
+
+TEST(Minimizer, MatchesByteByByteMinimization) {
+  std::mt19937 generator(7);
+  const std::string alphabet =
+      std::string("aZ09+/=-_ \t\n.,:;\"{}", 20) + std::string("\x00\x1f\x7f\x80\xc3\xff", 6);
+  for (int i = 0; i < 500; i++) {
+    std::string body;
+    const size_t size = generator() % 200;
+    while (body.size() < size) {
+      // Runs of random lengths, to cross word boundaries in every way
+      const char byte = alphabet[generator() % alphabet.size()];
+      body.append(generator() % 24 + 1, byte);
+    }
+    for (const Minimizer::Options& options :
+         {Minimizer::Options{true, 0}, Minimizer::Options{false, 5}, Minimizer::Options{true, 3}}) {
+      std::vector<size_t> expected_offsets;
+      const std::string expected = naiveMinimize(body, options, &expected_offsets);
+      std::string out;
+      OffsetMap offsets;
+      Minimizer(options).minimize(body, &out, &offsets);
+      ASSERT_EQ(expected, out) << "body " << i;
+      for (size_t j = 0; j < out.size(); j++) {
+        ASSERT_EQ(expected_offsets[j], offsets.original(j)) << "body " << i << " offset " << j;
+      }
+    }
+  }
+}
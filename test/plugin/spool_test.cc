@@ -0,0 +1,158 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <map>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "plugin/spool/spool.h"
+
+using google::dlp_filter::SharedStore;
+using google::dlp_filter::Spool;
+using google::dlp_filter::SpoolMessage;
+
+namespace {
+static const uint64_t Second = 1000000000;
+
+// Versioned map behaving like proxy-wasm shared data
+class FakeSharedStore : public SharedStore {
+ public:
+  bool get(std::string_view key, std::string* value, uint32_t* cas) override {
+    auto it = values_.find(std::string(key));
+    if (it == values_.end()) {
+      return false;
+    }
+    *value = it->second.first;
+    *cas = it->second.second;
+    return true;
+  }
+
+  bool set(std::string_view key, std::string_view value, uint32_t cas) override {
+    auto& [stored, version] = values_[std::string(key)];
+    if (cas != 0 && cas != version) {
+      return false;
+    }
+    stored = value;
+    version = ++version_;
+    return true;
+  }
+
+ private:
+  std::map<std::string, std::pair<std::string, uint32_t>> values_;
+  uint32_t version_ = 0;
+};
+
+std::vector<std::string> payloads(const std::vector<Spool::Entry>& entries) {
+  std::vector<std::string> result;
+  for (const Spool::Entry& entry : entries) {
+    result.push_back(entry.payload);
+  }
+  return result;
+}
+}
+
+TEST(SpoolMessage, RoundTrips) {
+  std::string payload;
+  SpoolMessage{3, 1, "route", std::string_view("a\0b", 3)}.appendTo(&payload);
+  SpoolMessage message;
+  ASSERT_TRUE(SpoolMessage::parse(payload, &message));
+  EXPECT_EQ(3, message.operations);
+  EXPECT_EQ(1, message.direction);
+  EXPECT_EQ("route", message.route);
+  EXPECT_EQ(std::string_view("a\0b", 3), message.body);
+  EXPECT_FALSE(SpoolMessage::parse(payload.substr(0, 6), &message));
+}
+
+TEST(Spool, BoundsBytesAndEntries) {
+  FakeSharedStore store;
+  Spool spool(&store, "s.", {10, 3, 60 * Second, 100});
+  spool.init();
+  EXPECT_TRUE(spool.push(Second, "aaaa"));
+  EXPECT_TRUE(spool.push(Second, "bbbb"));
+  EXPECT_FALSE(spool.push(Second, "ccc"));
+  EXPECT_TRUE(spool.push(Second, "cc"));
+  EXPECT_FALSE(spool.push(Second, ""));
+  const Spool::Depth depth = spool.depth(6 * Second);
+  EXPECT_EQ(3, depth.entries);
+  EXPECT_EQ(10, depth.bytes);
+  EXPECT_EQ(5 * Second, depth.oldest_age_ns);
+}
+
+TEST(Spool, DrainsAtConfiguredRateAcrossInstances) {
+  FakeSharedStore store;
+  Spool first(&store, "s.", {1000, 100, 60 * Second, 2});
+  Spool second(&store, "s.", {1000, 100, 60 * Second, 2});
+  first.init();
+  second.init();
+  for (int i = 0; i < 10; i++) {
+    ASSERT_TRUE(first.push(100 * Second, std::to_string(i)));
+  }
+  std::vector<Spool::Entry> entries;
+  std::vector<Spool::Entry> expired;
+  // Two entries per second are shared by both instances.
+  first.drain(101 * Second, &entries, &expired);
+  EXPECT_EQ(std::vector<std::string>({"0", "1"}), payloads(entries));
+  second.drain(101 * Second, &entries, &expired);
+  EXPECT_TRUE(entries.empty());
+  second.drain(101 * Second + Second / 2, &entries, &expired);
+  EXPECT_EQ(std::vector<std::string>({"2"}), payloads(entries));
+  EXPECT_EQ(100 * Second, entries[0].spooled_ns);
+  const Spool::Depth depth = first.depth(102 * Second);
+  EXPECT_EQ(7, depth.entries);
+  EXPECT_EQ(7, depth.bytes);
+  EXPECT_EQ(2 * Second, depth.oldest_age_ns);
+}
+
+TEST(Spool, ExpiresOldEntriesWithoutRateLimit) {
+  FakeSharedStore store;
+  Spool spool(&store, "s.", {1000, 100, 10 * Second, 1});
+  spool.init();
+  spool.push(0, "old1");
+  spool.push(1 * Second, "old2");
+  spool.push(20 * Second, "new1");
+  spool.push(20 * Second, "new2");
+  std::vector<Spool::Entry> entries;
+  std::vector<Spool::Entry> expired;
+  spool.drain(21 * Second, &entries, &expired);
+  EXPECT_EQ(std::vector<std::string>({"old1", "old2"}), payloads(expired));
+  EXPECT_EQ(std::vector<std::string>({"new1"}), payloads(entries));
+  EXPECT_EQ(1, spool.depth(21 * Second).entries);
+  EXPECT_EQ(Second, spool.depth(21 * Second).oldest_age_ns);
+}
+
+TEST(Spool, ReusesSlotsAndSkipsAbandonedEntries) {
+  FakeSharedStore store;
+  Spool spool(&store, "s.", {1000, 2, 60 * Second, 1000});
+  spool.init();
+  std::vector<Spool::Entry> entries;
+  std::vector<Spool::Entry> expired;
+  for (int i = 0; i < 5; i++) {
+    ASSERT_TRUE(spool.push(0, std::to_string(i)));
+    spool.drain(Second, &entries, &expired);
+    EXPECT_EQ(std::vector<std::string>({std::to_string(i)}), payloads(entries));
+  }
+
+  // An entry reserved by a push that never wrote it holds up draining once.
+  std::string value;
+  uint32_t cas;
+  ASSERT_TRUE(spool.push(0, "lost"));
+  ASSERT_TRUE(store.get("s.slot.1", &value, &cas));
+  store.set("s.slot.1", "", cas);
+  ASSERT_TRUE(spool.push(0, "next"));
+  spool.drain(2 * Second, &entries, &expired);
+  EXPECT_TRUE(entries.empty());
+  spool.drain(3 * Second, &entries, &expired);
+  EXPECT_EQ(std::vector<std::string>({"next"}), payloads(entries));
+  EXPECT_EQ(0, spool.depth(3 * Second).bytes);
+}
@@ -0,0 +1,141 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <map>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "plugin/stats/accumulator.h"
+#include "plugin/stats/tagged_metric.h"
+
+using google::dlp_filter::formatLabel;
+using google::dlp_filter::StatAccumulator;
+using google::dlp_filter::TaggedMetric;
+using google::dlp_filter::TagValues;
+
+TEST(FormatLabel, CanonicalizesValue) {
+  EXPECT_EQ("us_social_security_number", formatLabel("US_SOCIAL_SECURITY_NUMBER"));
+  EXPECT_EQ("xapi_route_v1", formatLabel("/api/route.v1"));
+  EXPECT_EQ(std::string(63, 'a'), formatLabel(std::string(100, 'a')));
+  EXPECT_EQ("", formatLabel(""));
+}
+
+TEST(TagValues, FoldsValuesBeyondLimitIntoOverflow) {
+  TagValues values("route", 2);
+  EXPECT_EQ(1, values.index("a"));
+  EXPECT_EQ(2, values.index("B"));
+  EXPECT_EQ(0, values.index("c"));
+  EXPECT_EQ(1, values.index("a"));
+  EXPECT_EQ(2, values.size());
+  EXPECT_EQ("b", values.value(2));
+  EXPECT_EQ(TagValues::Overflow, values.value(0));
+}
+
+TEST(TaggedMetric, ResolvesEachCombinationOnce) {
+  TagValues route("route", 10);
+  TagValues direction("direction", 2);
+  std::vector<std::string> resolved;
+  TaggedMetric metric("dlp_stat_inspected", {&route, &direction},
+                      [&resolved](const std::string& name) {
+                        resolved.push_back(name);
+                        return static_cast<uint32_t>(resolved.size());
+                      });
+
+  const uint16_t request = direction.index("request");
+  const uint16_t response = direction.index("response");
+  EXPECT_EQ(1, metric.id({route.index("orders"), request}));
+  EXPECT_EQ(2, metric.id({route.index("orders"), response}));
+  EXPECT_EQ(1, metric.id({route.index("orders"), request}));
+  EXPECT_EQ(3, metric.id({route.index("users"), request}));
+
+  EXPECT_EQ(3, metric.size());
+  ASSERT_EQ(3, resolved.size());
+  EXPECT_EQ("route.orders.direction.request.dlp_stat_inspected", resolved[0]);
+  EXPECT_EQ("route.orders.direction.response.dlp_stat_inspected", resolved[1]);
+}
+
+TEST(TaggedMetric, BoundsSeriesPerTag) {
+  TagValues info_type("info_type", 3);
+  uint32_t next_id = 0;
+  TaggedMetric metric("dlp_stat_findings", {&info_type},
+                      [&next_id](const std::string&) { return ++next_id; });
+
+  for (int i = 0; i < 100; i++) {
+    metric.id({info_type.index("TYPE_" + std::to_string(i))});
+  }
+  EXPECT_EQ(4, metric.size());
+  EXPECT_EQ(metric.id({0}), metric.id({info_type.index("TYPE_99")}));
+}
+
+TEST(StatAccumulator, ReportsSumsOnFlush) {
+  std::map<uint32_t, uint64_t> recorded;
+  int calls = 0;
+  StatAccumulator accumulator([&](uint32_t metric_id, uint64_t value) {
+    recorded[metric_id] += value;
+    calls++;
+  }, true);
+  const uint32_t a = accumulator.slot(7);
+  const uint32_t b = accumulator.slot(3);
+  EXPECT_EQ(a, accumulator.slot(7));
+
+  for (int i = 0; i < 10; i++) {
+    accumulator.add(a, 1);
+  }
+  accumulator.add(b, 100);
+  EXPECT_EQ(0, calls);
+  EXPECT_EQ(2, accumulator.pending());
+
+  accumulator.flush();
+  EXPECT_EQ(2, calls);
+  EXPECT_EQ(10, recorded[7]);
+  EXPECT_EQ(100, recorded[3]);
+
+  accumulator.flush();
+  EXPECT_EQ(2, calls);
+  accumulator.add(b, 1);
+  accumulator.flush();
+  EXPECT_EQ(3, calls);
+  EXPECT_EQ(101, recorded[3]);
+}
+
+TEST(StatAccumulator, ReportsRightAwayWhenNotBuffered) {
+  std::vector<std::pair<uint32_t, uint64_t>> recorded;
+  StatAccumulator accumulator([&](uint32_t metric_id, uint64_t value) {
+    recorded.emplace_back(metric_id, value);
+  }, false);
+  accumulator.add(accumulator.slot(5), 2);
+  ASSERT_EQ(1, recorded.size());
+  EXPECT_EQ(5, recorded[0].first);
+  EXPECT_EQ(2, recorded[0].second);
+  EXPECT_EQ(0, accumulator.pending());
+}
+
+TEST(StatAccumulator, IgnoresZeroIncrements) {
+  int calls = 0;
+  StatAccumulator buffered([&](uint32_t, uint64_t) { calls++; }, true);
+  const uint32_t slot = buffered.slot(1);
+  for (int i = 0; i < 10; i++) {
+    buffered.add(slot, 0);
+  }
+  EXPECT_EQ(0, buffered.pending());
+  buffered.add(slot, 1);
+  buffered.add(slot, 0);
+  EXPECT_EQ(1, buffered.pending());
+  buffered.flush();
+  EXPECT_EQ(1, calls);
+
+  StatAccumulator unbuffered([&](uint32_t, uint64_t) { calls++; }, false);
+  unbuffered.add(unbuffered.slot(1), 0);
+  EXPECT_EQ(1, calls);
+}
@@ -0,0 +1,47 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gtest/gtest.h"
+#include "plugin/ratelimit/token_bucket.h"
+
+using google::dlp_filter::TokenBucket;
+
+namespace {
+static const uint64_t Second = 1000000000;
+}
+
+TEST(TokenBucket, AllowsBurstThenRate) {
+  TokenBucket bucket(10, 5);
+  for (int i = 0; i < 5; i++) {
+    EXPECT_TRUE(bucket.tryAcquire(0));
+  }
+  EXPECT_FALSE(bucket.tryAcquire(0));
+  EXPECT_FALSE(bucket.tryAcquire(Second / 20));
+  EXPECT_TRUE(bucket.tryAcquire(Second / 10));
+  EXPECT_FALSE(bucket.tryAcquire(Second / 10));
+
+  int allowed = 0;
+  for (uint64_t now = Second; now < 2 * Second; now += Second / 1000) {
+    allowed += bucket.tryAcquire(now);
+  }
+  // Refilled burst plus ten per second
+  EXPECT_NEAR(15, allowed, 1);
+}
+
+TEST(TokenBucket, ZeroRateIsUnlimited) {
+  TokenBucket bucket(0, 0);
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_TRUE(bucket.tryAcquire(0));
+  }
+}
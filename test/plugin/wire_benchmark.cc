@@ -0,0 +1,80 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares reading findings with InspectContentResponseScanner against a full
+// parse with the generated code, as done by the filter before.
+//
+//   bazel run -c opt //test/plugin:wire_benchmark
+
+#include <string>
+#include "benchmark/benchmark.h"
+#include "google/privacy/dlp/v2/dlp.pb.h"
+#include "plugin/wire/decoder.h"
+
+using google::dlp_filter::FindingView;
+using google::dlp_filter::InspectContentResponseScanner;
+using google::privacy::dlp::v2::Finding;
+using google::privacy::dlp::v2::InspectContentResponse;
+using google::privacy::dlp::v2::Likelihood;
+
+namespace {
+
+// Response with the given number of findings, each with a quote and
+// locations as returned for templates with include_quote set.
+std::string makeResponse(int findings) {
+  InspectContentResponse response;
+  for (int i = 0; i < findings; i++) {
+    Finding* finding = response.mutable_result()->add_findings();
+    finding->set_quote("987-65-4321");
+    finding->mutable_info_type()->set_name("US_SOCIAL_SECURITY_NUMBER");
+    finding->set_likelihood(Likelihood::VERY_LIKELY);
+    finding->mutable_location()->mutable_byte_range()->set_start(i * 32 + 20);
+    finding->mutable_location()->mutable_byte_range()->set_end(i * 32 + 31);
+    finding->mutable_location()->mutable_codepoint_range()->set_start(i * 32 + 20);
+    finding->mutable_location()->mutable_codepoint_range()->set_end(i * 32 + 31);
+  }
+  return response.SerializeAsString();
+}
+
+void BM_FullParse(benchmark::State& state) {
+  const std::string serialized = makeResponse(state.range(0));
+  for (auto _ : state) {
+    InspectContentResponse response;
+    response.ParseFromArray(serialized.data(), serialized.size());
+    size_t info_type_bytes = 0;
+    for (const auto& finding : response.result().findings()) {
+      info_type_bytes += finding.info_type().name().size();
+    }
+    benchmark::DoNotOptimize(info_type_bytes);
+  }
+  state.SetBytesProcessed(state.iterations() * serialized.size());
+}
+BENCHMARK(BM_FullParse)->Arg(1)->Arg(10)->Arg(100)->Arg(1000);
+
+void BM_Scanner(benchmark::State& state) {
+  const std::string serialized = makeResponse(state.range(0));
+  for (auto _ : state) {
+    InspectContentResponseScanner scanner(serialized.data(), serialized.size());
+    FindingView finding;
+    size_t info_type_bytes = 0;
+    while (scanner.next(&finding)) {
+      info_type_bytes += finding.info_type.size();
+    }
+    benchmark::DoNotOptimize(info_type_bytes);
+  }
+  state.SetBytesProcessed(state.iterations() * serialized.size());
+}
+BENCHMARK(BM_Scanner)->Arg(1)->Arg(10)->Arg(100)->Arg(1000);
+
+}
@@ -0,0 +1,274 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "google/privacy/dlp/v2/dlp.pb.h"
+#include "plugin/wire/decoder.h"
+#include "plugin/wire/encoder.h"
+
+using google::dlp_filter::FindingView;
+using google::dlp_filter::HybridInspectRequestEncoder;
+using google::dlp_filter::InspectContentRequestEncoder;
+using google::dlp_filter::InspectContentResponseScanner;
+using google::dlp_filter::TableEncoder;
+using google::privacy::dlp::v2::Finding;
+using google::privacy::dlp::v2::HybridInspectJobTriggerRequest;
+using google::privacy::dlp::v2::InspectContentRequest;
+using google::privacy::dlp::v2::InspectContentResponse;
+using google::privacy::dlp::v2::Likelihood;
+using google::privacy::dlp::v2::Table;
+
+namespace {
+
+std::string generatedRequest(
+    const std::string& parent,
+    const std::string& template_name,
+    const std::string& location_id,
+    const std::string& data,
+    bool include_quote = false) {
+  InspectContentRequest request;
+  request.mutable_item()->mutable_byte_item()->set_data(data);
+  if (include_quote) {
+    request.mutable_inspect_config()->set_include_quote(true);
+  }
+  request.set_parent(parent);
+  request.set_inspect_template_name(template_name);
+  request.set_location_id(location_id);
+  return request.SerializeAsString();
+}
+
+}
+
+TEST(InspectContentRequestEncoder, MatchesGeneratedCode) {
+  const std::string parent = "projects/test-project/locations/us";
+  InspectContentRequestEncoder encoder(parent, "test-template", "us", false);
+  // Sizes around the 1, 2 and 3 byte varint length boundaries.
+  for (const size_t size : {1, 127, 128, 16383, 16384, 500000}) {
+    std::string data(size, 'a');
+    data[0] = '\0';
+    EXPECT_EQ(generatedRequest(parent, "test-template", "us", data),
+        encoder.encode(data.data(), data.size())) << "size " << size;
+  }
+}
+
+TEST(InspectContentRequestEncoder, IncludesQuotes) {
+  const std::string parent = "projects/test-project/locations/us";
+  InspectContentRequestEncoder encoder(parent, "test-template", "us", true);
+  const std::string data = "Hi, this is my SSN: 987-65-4321.";
+  EXPECT_EQ(generatedRequest(parent, "test-template", "us", data, true),
+      encoder.encode(data.data(), data.size()));
+}
+
+TEST(InspectContentRequestEncoder, OmitsEmptyFields) {
+  InspectContentRequestEncoder encoder("projects/p/locations/global", "", "", false);
+  const std::string data = "Hi, this is my SSN: 987-65-4321.";
+  EXPECT_EQ(generatedRequest("projects/p/locations/global", "", "", data),
+      encoder.encode(data.data(), data.size()));
+  EXPECT_EQ(generatedRequest("projects/p/locations/global", "", "", ""),
+      encoder.encode(data.data(), 0));
+}
+
+TEST(InspectContentRequestEncoder, ReusesOutputBuffer) {
+  InspectContentRequestEncoder encoder("projects/p/locations/global", "", "", false);
+  encoder.reserve(1024);
+  const std::string data(1024, 'x');
+  const char* first = encoder.encode(data.data(), data.size()).data();
+  const char* second = encoder.encode(data.data(), 10).data();
+  EXPECT_EQ(first, second);
+}
+
+TEST(InspectContentRequestEncoder, EncodesTables) {
+  const std::string parent = "projects/test-project/locations/us";
+  InspectContentRequestEncoder encoder(parent, "test-template", "us", true);
+  TableEncoder table({"direction", "field", "value"});
+  table.addRow({"request", "url", "api.example.com/users?ssn=987-65-4321"});
+  table.addRow({"response", "body", std::string(300, 'a')});
+
+  InspectContentRequest request;
+  request.set_parent(parent);
+  request.mutable_inspect_config()->set_include_quote(true);
+  request.set_inspect_template_name("test-template");
+  request.set_location_id("us");
+  Table* expected = request.mutable_item()->mutable_table();
+  for (const char* header : {"direction", "field", "value"}) {
+    expected->add_headers()->set_name(header);
+  }
+  for (const auto& row : std::vector<std::vector<std::string>>{
+      {"request", "url", "api.example.com/users?ssn=987-65-4321"},
+      {"response", "body", std::string(300, 'a')}}) {
+    Table::Row* expected_row = expected->add_rows();
+    for (const std::string& value : row) {
+      expected_row->add_values()->set_string_value(value);
+    }
+  }
+  EXPECT_EQ(request.SerializeAsString(), encoder.encode(table));
+}
+
+TEST(HybridInspectRequestEncoder, MatchesGeneratedCode) {
+  const std::string name = "projects/p/locations/global/jobTriggers/t";
+  TableEncoder table({"route", "direction", "content"});
+  table.addRow({"orders", "request", "Hi, this is my SSN: 987-65-4321."});
+  table.addRow({"orders", "response", std::string(300, 'a')});
+  table.addRow({"", "response", ""});
+  EXPECT_EQ(3, table.rowCount());
+
+  HybridInspectJobTriggerRequest request;
+  request.set_name(name);
+  Table* expected = request.mutable_hybrid_item()->mutable_item()->mutable_table();
+  for (const char* header : {"route", "direction", "content"}) {
+    expected->add_headers()->set_name(header);
+  }
+  for (const auto& row : std::vector<std::vector<std::string>>{
+      {"orders", "request", "Hi, this is my SSN: 987-65-4321."},
+      {"orders", "response", std::string(300, 'a')},
+      {"", "response", ""}}) {
+    Table::Row* expected_row = expected->add_rows();
+    for (const std::string& value : row) {
+      expected_row->add_values()->set_string_value(value);
+    }
+  }
+
+  HybridInspectRequestEncoder encoder(name);
+  EXPECT_EQ(request.SerializeAsString(), encoder.encode(table));
+
+  table.clear();
+  expected->clear_rows();
+  EXPECT_EQ(request.SerializeAsString(), encoder.encode(table));
+}
+
+TEST(TableEncoder, ReplacesInvalidUtf8) {
+  TableEncoder table({"content"});
+  table.addRow({std::string("ok \xc3\xa9 \xff\xc3 \xed\xa0\x80 \xf0\x9f\x98\x80", 17)});
+
+  std::string encoded;
+  table.appendTo(&encoded);
+  Table parsed;
+  ASSERT_TRUE(parsed.ParseFromString(encoded));
+  EXPECT_EQ("ok \xc3\xa9 \xef\xbf\xbd\xef\xbf\xbd "
+            "\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd \xf0\x9f\x98\x80",
+            parsed.rows(0).values(0).string_value());
+}
+
+TEST(TableEncoder, ReportsBinaryValues) {
+  TableEncoder table({"field", "value"});
+  const std::string binary_body("\x89PNG\r\n\x1a\n\x00\x00\x00\rIHDR 987-65-4321", 28);
+  EXPECT_TRUE(table.addRow({"body", "SSN: 987-65-4321"}));
+  EXPECT_FALSE(table.addRow({"body", binary_body}));
+  EXPECT_TRUE(table.addRow({"body", "caf\xc3\xa9"}));
+
+  std::string encoded;
+  table.appendTo(&encoded);
+  Table parsed;
+  ASSERT_TRUE(parsed.ParseFromString(encoded));
+  ASSERT_EQ(3, parsed.rows_size());
+  // The replaced byte moves the cell's offsets past the original ones.
+  const std::string& value = parsed.rows(1).values(1).string_value();
+  EXPECT_EQ(binary_body.size() + 2, value.size());
+  EXPECT_EQ(binary_body.find("987-65-4321") + 2, value.find("987-65-4321"));
+}
+
+TEST(InspectContentResponseScanner, ReadsFindings) {
+  InspectContentResponse response;
+  Finding* ssn = response.mutable_result()->add_findings();
+  ssn->set_quote("987-65-4321");
+  ssn->mutable_info_type()->set_name("US_SOCIAL_SECURITY_NUMBER");
+  ssn->set_likelihood(Likelihood::VERY_LIKELY);
+  ssn->mutable_location()->mutable_byte_range()->set_start(20);
+  ssn->mutable_location()->mutable_byte_range()->set_end(31);
+  ssn->mutable_location()->mutable_codepoint_range()->set_end(31);
+  Finding* email = response.mutable_result()->add_findings();
+  email->mutable_info_type()->set_name("EMAIL_ADDRESS");
+  response.mutable_result()->set_findings_truncated(true);
+  const std::string serialized = response.SerializeAsString();
+
+  InspectContentResponseScanner scanner(serialized.data(), serialized.size());
+  FindingView finding;
+  ASSERT_TRUE(scanner.next(&finding));
+  EXPECT_EQ("US_SOCIAL_SECURITY_NUMBER", finding.info_type);
+  EXPECT_EQ("987-65-4321", finding.quote);
+  EXPECT_EQ(Likelihood::VERY_LIKELY, finding.likelihood);
+  EXPECT_TRUE(finding.has_byte_range);
+  EXPECT_EQ(20, finding.byte_range_start);
+  EXPECT_EQ(31, finding.byte_range_end);
+  ASSERT_TRUE(scanner.next(&finding));
+  EXPECT_EQ("EMAIL_ADDRESS", finding.info_type);
+  EXPECT_EQ("", finding.quote);
+  EXPECT_EQ(0, finding.likelihood);
+  EXPECT_FALSE(finding.has_byte_range);
+  EXPECT_FALSE(scanner.next(&finding));
+  EXPECT_FALSE(scanner.malformed());
+}
+
+TEST(InspectContentResponseScanner, ReadsTableLocations) {
+  InspectContentResponse response;
+  Finding* ssn = response.mutable_result()->add_findings();
+  ssn->mutable_info_type()->set_name("US_SOCIAL_SECURITY_NUMBER");
+  ssn->mutable_location()->mutable_byte_range()->set_start(4);
+  ssn->mutable_location()->mutable_byte_range()->set_end(15);
+  ssn->mutable_location()->add_content_locations()->set_container_name("table");
+  auto* record = ssn->mutable_location()->add_content_locations()->mutable_record_location();
+  record->mutable_field_id()->set_name("value");
+  record->mutable_table_location()->set_row_index(3);
+  response.mutable_result()->add_findings()->mutable_info_type()->set_name("EMAIL_ADDRESS");
+  const std::string serialized = response.SerializeAsString();
+
+  InspectContentResponseScanner scanner(serialized.data(), serialized.size());
+  FindingView finding;
+  ASSERT_TRUE(scanner.next(&finding));
+  EXPECT_TRUE(finding.has_table_location);
+  EXPECT_EQ("value", finding.field);
+  EXPECT_EQ(3, finding.row_index);
+  EXPECT_EQ(4, finding.byte_range_start);
+  ASSERT_TRUE(scanner.next(&finding));
+  EXPECT_FALSE(finding.has_table_location);
+  EXPECT_EQ("", finding.field);
+  EXPECT_FALSE(scanner.next(&finding));
+}
+
+TEST(InspectContentResponseScanner, EmptyResponse) {
+  InspectContentResponseScanner scanner(nullptr, 0);
+  FindingView finding;
+  EXPECT_FALSE(scanner.next(&finding));
+  EXPECT_FALSE(scanner.malformed());
+}
+
+TEST(InspectContentResponseScanner, MergesRepeatedResults) {
+  InspectContentResponse first;
+  first.mutable_result()->add_findings()->mutable_info_type()->set_name("A");
+  InspectContentResponse second;
+  second.mutable_result()->add_findings()->mutable_info_type()->set_name("B");
+  const std::string serialized = first.SerializeAsString() + second.SerializeAsString();
+
+  InspectContentResponseScanner scanner(serialized.data(), serialized.size());
+  FindingView finding;
+  ASSERT_TRUE(scanner.next(&finding));
+  EXPECT_EQ("A", finding.info_type);
+  ASSERT_TRUE(scanner.next(&finding));
+  EXPECT_EQ("B", finding.info_type);
+  EXPECT_FALSE(scanner.next(&finding));
+}
+
+TEST(InspectContentResponseScanner, DetectsTruncatedResponse) {
+  InspectContentResponse response;
+  response.mutable_result()->add_findings()->mutable_info_type()->set_name("EMAIL_ADDRESS");
+  const std::string serialized = response.SerializeAsString();
+  for (size_t size = 1; size < serialized.size(); size++) {
+    InspectContentResponseScanner scanner(serialized.data(), size);
+    FindingView finding;
+    EXPECT_FALSE(scanner.next(&finding)) << "size " << size;
+    EXPECT_TRUE(scanner.malformed()) << "size " << size;
+  }
+}